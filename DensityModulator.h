@@ -0,0 +1,83 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * DensityModulator
+ * The slowly drifting per-bin fluctuation behind the density parameter.
+ *
+ * Each bin follows 0.5 + 0.5 * sin(0.3 * bin + phase), where the phase is the
+ * stream time of the frame plus a seeded offset. Splitting the sine as
+ * sin(a) cos(p) + cos(a) sin(p) leaves two trig calls per frame and a
+ * multiply-add per bin against precomputed tables. Because the phase comes
+ * from the engine's sample count rather than a wall clock, renders are
+ * repeatable and identical whether they run in realtime or offline.
+ */
+class DensityModulator
+{
+public:
+    DensityModulator() = default;
+
+    // Builds the bin tables and resets the phase. Must not be called on the audio thread.
+    void prepare(int maxNumBins, double newSampleRate, juce::uint32 seed)
+    {
+        sinTable.malloc((size_t) maxNumBins);
+        cosTable.malloc((size_t) maxNumBins);
+        numTableBins = maxNumBins;
+
+        for (int i = 0; i < maxNumBins; ++i)
+        {
+            sinTable[i] = std::sin(i * binPhaseStep);
+            cosTable[i] = std::cos(i * binPhaseStep);
+        }
+
+        sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+
+        // One xorshift round spreads the seed over the initial phase
+        seed = seed != 0 ? seed : 0x9e3779b9u;
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        initialPhase = juce::MathConstants<double>::twoPi * (seed / 4294967296.0);
+    }
+
+    // Scales bins 1 to numBins - 2 of the spectrum by 1 - 0.3 * density * fluctuation,
+    // for the frame that completed at streamPosition. The spectra of NumChannels
+    // channels are interleaved (bin i of channel c at real[i * NumChannels + c])
+    // and share each bin's factor.
+    template <int NumChannels, typename SampleType>
+    void apply(SampleType* real, SampleType* imag, int numBins, float density, juce::int64 streamPosition) const noexcept
+    {
+        jassert(numBins <= numTableBins);
+
+        const double phase = std::fmod(initialPhase + streamPosition / sampleRate, juce::MathConstants<double>::twoPi);
+
+        // factor = 1 - 0.3 * density * (0.5 + 0.5 * (sin(a) cos(p) + cos(a) sin(p)))
+        const float depth = 0.15f * density;
+        const float offset = 1.0f - depth;
+        const float sinWeight = -depth * (float) std::cos(phase);
+        const float cosWeight = -depth * (float) std::sin(phase);
+
+        for (int i = 1; i < juce::jmin(numBins, numTableBins) - 1; ++i)
+        {
+            const auto factor = (SampleType) (offset + sinWeight * sinTable[i] + cosWeight * cosTable[i]);
+
+            for (int channel = 0; channel < NumChannels; ++channel)
+            {
+                real[i * NumChannels + channel] *= factor;
+                imag[i * NumChannels + channel] *= factor;
+            }
+        }
+    }
+
+private:
+    static constexpr float binPhaseStep = 0.3f;
+
+    juce::HeapBlock<float> sinTable, cosTable;
+    int numTableBins = 0;
+    double sampleRate = 44100.0;
+    double initialPhase = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DensityModulator)
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * DoublePrecisionFFT
+ * A real-only FFT in double precision, with the same interface, data layout
+ * and scaling as juce::dsp::FFT's real-only transforms, which only come in float.
+ *
+ * The forward transform reads fftSize reals and writes interleaved complex
+ * bins; the inverse reads bins 0 to fftSize / 2 and writes fftSize reals,
+ * including the 1 / fftSize factor, so a round trip returns the input.
+ *
+ * Internally the real signal is packed into a complex one of half the length
+ * (even samples real, odd samples imaginary), run through an iterative radix-2
+ * FFT and then split back into the real signal's spectrum. All tables and
+ * scratch are built in the constructor, so the transforms never allocate.
+ */
+class DoublePrecisionFFT
+{
+public:
+    explicit DoublePrecisionFFT(int order)
+        : size(1 << order), halfSize(size / 2)
+    {
+        jassert(order >= 2);
+
+        const int halfOrder = order - 1;
+
+        bitReversed.malloc((size_t) halfSize);
+
+        for (int i = 0; i < halfSize; ++i)
+        {
+            int reversed = 0;
+
+            for (int bit = 0; bit < halfOrder; ++bit)
+                reversed |= ((i >> bit) & 1) << (halfOrder - 1 - bit);
+
+            bitReversed[i] = reversed;
+        }
+
+        // e^(-2 pi i k / halfSize) for the butterflies, e^(-2 pi i k / size) for the split
+        butterflyTwiddles.malloc((size_t) juce::jmax(1, halfSize / 2));
+        splitTwiddles.malloc((size_t) halfSize + 1);
+
+        for (int k = 0; k < halfSize / 2; ++k)
+            butterflyTwiddles[k] = std::polar(1.0, -juce::MathConstants<double>::twoPi * k / halfSize);
+
+        for (int k = 0; k <= halfSize; ++k)
+            splitTwiddles[k] = std::polar(1.0, -juce::MathConstants<double>::twoPi * k / size);
+
+        work.malloc((size_t) halfSize);
+    }
+
+    int getSize() const noexcept { return size; }
+
+    //==============================================================================
+    // data holds getSize() reals on input and must have room for 2 * getSize()
+    // values. Writes bins 0 to getSize() / 2 as interleaved real/imaginary pairs,
+    // or all getSize() bins unless onlyCalculateNonNegativeFrequencies is set.
+    void performRealOnlyForwardTransform(double* data, bool onlyCalculateNonNegativeFrequencies = false) const noexcept
+    {
+        for (int n = 0; n < halfSize; ++n)
+            work[n] = { data[n * 2], data[n * 2 + 1] };
+
+        transform(false);
+
+        // X[k] = E[k] + W^k O[k], where E and O are the spectra of the even and
+        // odd samples: E[k] = (Z[k] + Z*[M - k]) / 2, O[k] = -i (Z[k] - Z*[M - k]) / 2
+        for (int k = 0; k <= halfSize; ++k)
+        {
+            const auto z = work[k & (halfSize - 1)];
+            const auto mirror = std::conj(work[(halfSize - k) & (halfSize - 1)]);
+            const auto even = (z + mirror) * 0.5;
+            const auto odd = multiply(z - mirror, { 0.0, -0.5 });
+            const auto bin = even + multiply(splitTwiddles[k], odd);
+
+            data[k * 2] = bin.real();
+            data[k * 2 + 1] = bin.imag();
+        }
+
+        if (onlyCalculateNonNegativeFrequencies)
+            return;
+
+        for (int k = halfSize + 1; k < size; ++k)
+        {
+            data[k * 2] = data[(size - k) * 2];
+            data[k * 2 + 1] = -data[(size - k) * 2 + 1];
+        }
+    }
+
+    // data holds bins 0 to getSize() / 2 as interleaved real/imaginary pairs on
+    // input, and the getSize() reals of the signal on output
+    void performRealOnlyInverseTransform(double* data) const noexcept
+    {
+        // Undo the split: E[k] = (X[k] + X*[M - k]) / 2, O[k] = W^-k (X[k] - X*[M - k]) / 2,
+        // and repack as Z[k] = E[k] + i O[k]
+        for (int k = 0; k < halfSize; ++k)
+        {
+            const std::complex<double> bin { data[k * 2], data[k * 2 + 1] };
+            const auto mirror = std::conj(std::complex<double> { data[(halfSize - k) * 2], data[(halfSize - k) * 2 + 1] });
+            const auto even = (bin + mirror) * 0.5;
+            const auto odd = multiply((bin - mirror) * 0.5, std::conj(splitTwiddles[k]));
+
+            work[k] = even + multiply(odd, { 0.0, 1.0 });
+        }
+
+        transform(true);
+
+        const double scale = 1.0 / halfSize;
+
+        for (int n = 0; n < halfSize; ++n)
+        {
+            data[n * 2] = work[n].real() * scale;
+            data[n * 2 + 1] = work[n].imag() * scale;
+        }
+    }
+
+private:
+    //==============================================================================
+    // Plain arithmetic, so the compiler doesn't insert the NaN recovery of operator*
+    static std::complex<double> multiply(std::complex<double> a, std::complex<double> b) noexcept
+    {
+        return { a.real() * b.real() - a.imag() * b.imag(),
+                 a.real() * b.imag() + a.imag() * b.real() };
+    }
+
+    // In-place radix-2 transform of work, unscaled in both directions
+    void transform(bool inverse) const noexcept
+    {
+        for (int i = 0; i < halfSize; ++i)
+            if (i < bitReversed[i])
+                std::swap(work[i], work[bitReversed[i]]);
+
+        for (int span = 1; span < halfSize; span *= 2)
+        {
+            const int twiddleStride = halfSize / (span * 2);
+
+            for (int start = 0; start < halfSize; start += span * 2)
+            {
+                for (int j = 0; j < span; ++j)
+                {
+                    const auto twiddle = butterflyTwiddles[j * twiddleStride];
+                    const auto t = multiply(work[start + j + span], inverse ? std::conj(twiddle) : twiddle);
+
+                    work[start + j + span] = work[start + j] - t;
+                    work[start + j] += t;
+                }
+            }
+        }
+    }
+
+    const int size, halfSize;
+    juce::HeapBlock<int> bitReversed;
+    juce::HeapBlock<std::complex<double>> butterflyTwiddles, splitTwiddles;
+    juce::HeapBlock<std::complex<double>> work;     // halfSize, scratch for one transform at a time
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DoublePrecisionFFT)
+};
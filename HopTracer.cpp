@@ -0,0 +1,193 @@
+﻿#include "HopTracer.h"
+
+//==============================================================================
+class HopTracer::Writer : public juce::Thread
+{
+public:
+    explicit Writer(HopTracer& t)
+        : juce::Thread("Hop trace writer"), tracer(t)
+    {
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            tracer.drainToStream();
+            wait(drainIntervalMs);
+        }
+    }
+
+private:
+    static constexpr int drainIntervalMs = 50;
+
+    HopTracer& tracer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Writer)
+};
+
+//==============================================================================
+const char* HopTracer::getStageName(Stage stage) noexcept
+{
+    switch (stage)
+    {
+        case Stage::block:                  return "processBlock";
+        case Stage::window:                 return "window";
+        case Stage::forwardFFT:             return "forward FFT";
+        case Stage::spectralProcessing:     return "applySpectralProcessing";
+        case Stage::inverseFFT:             return "inverse FFT";
+        case Stage::overlapAdd:             return "overlap-add";
+        case Stage::guiPublish:             return "GUI publish";
+        case Stage::numStages:              break;
+    }
+
+    return "unknown";
+}
+
+HopTracer::HopTracer() = default;
+
+HopTracer::~HopTracer()
+{
+    stopTracing();
+}
+
+//==============================================================================
+bool HopTracer::startTracing(const juce::File& file)
+{
+    stopTracing();
+
+    file.deleteFile();
+    stream = file.createOutputStream();
+
+    if (stream == nullptr)
+        return false;
+
+    if (ring == nullptr)
+    {
+        ring.reset(new Cell[(size_t) ringSize]);
+
+        for (juce::uint64 i = 0; i < (juce::uint64) ringSize; ++i)
+            ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Throw away anything a scope that straddled the last stop left behind
+    Event discarded;
+    while (pop(discarded)) {}
+
+    threadIndices.clear();
+    startTicks = juce::Time::getHighResolutionTicks();
+    isFirstEvent = true;
+    numDroppedEvents.store(0);
+
+    *stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    writer = std::make_unique<Writer>(*this);
+    writer->startThread(juce::Thread::Priority::low);
+
+    enabled.store(true);
+    return true;
+}
+
+void HopTracer::stopTracing()
+{
+    if (stream == nullptr)
+        return;
+
+    enabled.store(false);
+
+    if (writer != nullptr)
+        writer->stopThread(1000);
+
+    writer.reset();
+
+    // Flush what the writer hadn't got to yet
+    drainToStream();
+
+    *stream << "]}";
+    stream->flush();
+    stream.reset();
+}
+
+//==============================================================================
+void HopTracer::record(Stage stage, bool isBegin, int channel) noexcept
+{
+    const auto ticks = juce::Time::getHighResolutionTicks();
+    auto position = writePosition.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        auto& cell = ring[position & ringMask];
+        const auto sequence = cell.sequence.load(std::memory_order_acquire);
+
+        if (sequence == position)
+        {
+            // The cell is free; claim it unless another thread got there first
+            if (writePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                cell.event = { ticks, juce::Thread::getCurrentThreadId(), channel, stage, isBegin };
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (sequence < position)
+        {
+            // The writer thread hasn't freed this cell yet: the ring is full
+            numDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = writePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool HopTracer::pop(Event& event) noexcept
+{
+    auto& cell = ring[readPosition & ringMask];
+
+    if (cell.sequence.load(std::memory_order_acquire) != readPosition + 1)
+        return false;
+
+    event = cell.event;
+    cell.sequence.store(readPosition + ringSize, std::memory_order_release);
+    ++readPosition;
+    return true;
+}
+
+void HopTracer::drainToStream()
+{
+    const double microsecondsPerTick = 1.0e6 / (double) juce::Time::getHighResolutionTicksPerSecond();
+    Event event;
+
+    while (pop(event))
+    {
+        // Chrome wants small integer thread ids; name each one the first time it
+        // appears, calling it the audio thread if that first event is a block
+        auto found = threadIndices.find(event.threadID);
+
+        if (found == threadIndices.end())
+        {
+            const int index = (int) threadIndices.size() + 1;
+            found = threadIndices.emplace(event.threadID, index).first;
+
+            *stream << (isFirstEvent ? "" : ",")
+                    << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index
+                    << ",\"args\":{\"name\":\"" << (event.stage == Stage::block ? "audio" : "thread " + juce::String(index)) << "\"}}";
+            isFirstEvent = false;
+        }
+
+        *stream << (isFirstEvent ? "" : ",")
+                << "\n{\"name\":\"" << getStageName(event.stage)
+                << "\",\"cat\":\"" << (event.stage == Stage::block ? "block" : "hop")
+                << "\",\"ph\":\"" << (event.isBegin ? "B" : "E")
+                << "\",\"ts\":" << juce::String((double) (event.ticks - startTicks) * microsecondsPerTick, 3)
+                << ",\"pid\":1,\"tid\":" << found->second;
+
+        if (event.channel >= 0)
+            *stream << ",\"args\":{\"channel\":" << event.channel << "}";
+
+        *stream << "}";
+        isFirstEvent = false;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * HopTracer
+ * Records begin/end events for the stages of processBlock and of every STFT
+ * hop, and writes them to a Chrome/Perfetto JSON trace (chrome://tracing,
+ * ui.perfetto.dev), so spikes can be lined up against host callbacks.
+ *
+ * Events go into a preallocated bounded ring that any number of threads (the
+ * audio thread and the spectral workers) can push to without locks or
+ * allocation; when the ring is full, events are dropped and counted. A
+ * background thread drains the ring to the file.
+ *
+ * While tracing is off, a Scope costs one relaxed load and a branch that is
+ * always predicted, and the ring isn't even allocated until the first start.
+ */
+class HopTracer
+{
+public:
+    //==============================================================================
+    enum class Stage : juce::uint8
+    {
+        block,                  // a whole processBlock call
+        window,
+        forwardFFT,
+        spectralProcessing,
+        inverseFFT,
+        overlapAdd,
+        guiPublish,             // feeding the spectrum analyser
+        numStages
+    };
+
+    static const char* getStageName(Stage stage) noexcept;
+
+    //==============================================================================
+    HopTracer();
+    ~HopTracer();
+
+    // Starts writing a new trace to the file, replacing it. Call from the message thread.
+    bool startTracing(const juce::File& file);
+
+    // Writes the remaining events and closes the file. Call from the message thread.
+    void stopTracing();
+
+    bool isTracing() const noexcept { return enabled.load(std::memory_order_relaxed); }
+    juce::uint64 getNumDroppedEvents() const noexcept { return numDroppedEvents.load(std::memory_order_relaxed); }
+
+    //==============================================================================
+    // Records the begin event on construction and the end event on destruction,
+    // if tracing was on when the scope opened
+    class Scope
+    {
+    public:
+        Scope(HopTracer& t, Stage s, int channel = -1) noexcept
+            : tracer(t.isTracing() ? &t : nullptr), stage(s), channelIndex(channel)
+        {
+            if (tracer != nullptr)
+                tracer->record(stage, true, channelIndex);
+        }
+
+        ~Scope() noexcept
+        {
+            if (tracer != nullptr)
+                tracer->record(stage, false, channelIndex);
+        }
+
+    private:
+        HopTracer* const tracer;
+        const Stage stage;
+        const int channelIndex;
+
+        JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+private:
+    //==============================================================================
+    struct Event
+    {
+        juce::int64 ticks;
+        juce::Thread::ThreadID threadID;
+        int channel;
+        Stage stage;
+        bool isBegin;
+    };
+
+    // One ring cell; sequence says whether it is free for the writer claiming
+    // position p (sequence == p) or holds the event written at p (sequence == p + 1)
+    struct Cell
+    {
+        std::atomic<juce::uint64> sequence { 0 };
+        Event event {};
+    };
+
+    class Writer;
+
+    void record(Stage stage, bool isBegin, int channel) noexcept;
+    bool pop(Event& event) noexcept;
+    void drainToStream();
+
+    static constexpr int ringSize = 1 << 16;
+    static constexpr juce::uint64 ringMask = ringSize - 1;
+
+    std::unique_ptr<Cell[]> ring;
+    std::atomic<juce::uint64> writePosition { 0 };
+    juce::uint64 readPosition = 0;                  // writer thread only
+
+    std::atomic<bool> enabled { false };
+    std::atomic<juce::uint64> numDroppedEvents { 0 };
+
+    // Writer thread only
+    std::unique_ptr<Writer> writer;
+    std::unique_ptr<juce::FileOutputStream> stream;
+    std::map<juce::Thread::ThreadID, int> threadIndices;
+    juce::int64 startTicks = 0;
+    bool isFirstEvent = true;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HopTracer)
+};
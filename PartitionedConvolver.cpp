@@ -0,0 +1,393 @@
+﻿#include "PartitionedConvolver.h"
+#include "SpectralKernels.h"
+
+//==============================================================================
+namespace
+{
+    void unpackSpectrum(const float* workspace, float* real, float* imag, int numBins) noexcept
+    {
+        for (int i = 0; i < numBins; ++i)
+        {
+            real[i] = workspace[i * 2];
+            imag[i] = workspace[i * 2 + 1];
+        }
+    }
+
+    void packSpectrum(const float* real, const float* imag, float* workspace, int numBins) noexcept
+    {
+        for (int i = 0; i < numBins; ++i)
+        {
+            workspace[i * 2] = real[i];
+            workspace[i * 2 + 1] = imag[i];
+        }
+    }
+
+    // Spectra of numPartitions zero-padded partitions of source, starting at firstSample
+    void computePartitionSpectra(juce::dsp::FFT& fft, float* workspace, const float* source, int sourceLength,
+                                 int firstSample, int partitionLength, int numPartitions, float* real, float* imag)
+    {
+        const int fftLength = partitionLength * 2;
+        const int bins = partitionLength + 1;
+
+        for (int partition = 0; partition < numPartitions; ++partition)
+        {
+            const int offset = firstSample + partition * partitionLength;
+            const int length = source != nullptr ? juce::jmin(partitionLength, sourceLength - offset) : 0;
+
+            juce::FloatVectorOperations::clear(workspace, fftLength * 2);
+
+            if (length > 0)
+                juce::FloatVectorOperations::copy(workspace, source + offset, length);
+
+            fft.performRealOnlyForwardTransform(workspace, true);
+            unpackSpectrum(workspace, real + partition * bins, imag + partition * bins, bins);
+        }
+    }
+}
+
+//==============================================================================
+PartitionedConvolver::PartitionedConvolver(const juce::AudioBuffer<float>& impulseResponse, int numChannels)
+    : impulseLength(juce::jmax(1, impulseResponse.getNumSamples())),
+      numHeadPartitions((juce::jmin(impulseLength, tailOffset) + partitionSize - 1) / partitionSize),
+      numTailPartitions(juce::jmax(0, impulseLength - tailOffset + tailPartitionSize - 1) / tailPartitionSize)
+{
+    jassert(numChannels > 0 && impulseResponse.getNumChannels() > 0);
+
+    const int numImpulseChannels = juce::jmin(juce::jmax(1, impulseResponse.getNumChannels()), numChannels);
+    const size_t spectraLength = (size_t) numHeadPartitions * numBins;
+    const size_t tailSpectraLength = (size_t) numTailPartitions * tailNumBins;
+    const bool hasTail = numTailPartitions > 0;
+
+    const size_t headChannelBytes = SpectralWorkArena::bytesFor<float>(fftSize) + SpectralWorkArena::bytesFor<float>(partitionSize)
+                                  + SpectralWorkArena::bytesFor<float>(spectraLength) * 2 + SpectralWorkArena::bytesFor<float>(numBins) * 2;
+    const size_t tailChannelBytes = hasTail ? SpectralWorkArena::bytesFor<float>(tailPartitionSize * 2) * 2
+                                              + SpectralWorkArena::bytesFor<float>(tailFFTSize * 2)
+                                              + SpectralWorkArena::bytesFor<float>(tailSpectraLength) * 2
+                                              + SpectralWorkArena::bytesFor<float>(tailNumBins) * 2
+                                            : 0;
+
+    arena.allocate((SpectralWorkArena::bytesFor<float>(spectraLength) + SpectralWorkArena::bytesFor<float>(tailSpectraLength)) * 2 * (size_t) numImpulseChannels
+                   + (headChannelBytes + tailChannelBytes) * (size_t) numChannels
+                   + SpectralWorkArena::bytesFor<float>(fftSize * 2));
+
+    fftWorkspace = arena.take<float>(fftSize * 2);
+
+    // Precompute the spectrum of every zero-padded IR partition
+    std::vector<const float*> impulseSpectraReal, impulseSpectraImag, tailSpectraReal, tailSpectraImag;
+    std::vector<float> tailWorkspace(hasTail ? (size_t) tailFFTSize * 2 : 0);
+
+    for (int irChannel = 0; irChannel < numImpulseChannels; ++irChannel)
+    {
+        float* real = arena.take<float>(spectraLength);
+        float* imag = arena.take<float>(spectraLength);
+        const float* source = impulseResponse.getNumSamples() > 0 ? impulseResponse.getReadPointer(irChannel) : nullptr;
+
+        computePartitionSpectra(fft, fftWorkspace, source, impulseResponse.getNumSamples(), 0, partitionSize, numHeadPartitions, real, imag);
+        impulseSpectraReal.push_back(real);
+        impulseSpectraImag.push_back(imag);
+
+        float* tailReal = arena.take<float>(tailSpectraLength);
+        float* tailImag = arena.take<float>(tailSpectraLength);
+
+        if (hasTail)
+            computePartitionSpectra(tailFFT, tailWorkspace.data(), source, impulseResponse.getNumSamples(),
+                                    tailOffset, tailPartitionSize, numTailPartitions, tailReal, tailImag);
+
+        tailSpectraReal.push_back(tailReal);
+        tailSpectraImag.push_back(tailImag);
+    }
+
+    channels.resize((size_t) numChannels);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        auto& state = channels[(size_t) channel];
+        const auto irChannel = (size_t) (channel % numImpulseChannels);
+
+        state.inputFrame = arena.take<float>(fftSize);
+        state.outputBlock = arena.take<float>(partitionSize);
+        state.delayLineReal = arena.take<float>(spectraLength);
+        state.delayLineImag = arena.take<float>(spectraLength);
+        state.nextReal = arena.take<float>(numBins);
+        state.nextImag = arena.take<float>(numBins);
+        state.impulseReal = impulseSpectraReal[irChannel];
+        state.impulseImag = impulseSpectraImag[irChannel];
+
+        if (hasTail)
+        {
+            state.tailInput = arena.take<float>(tailPartitionSize * 2);
+            state.tailWorkspace = arena.take<float>(tailFFTSize * 2);
+            state.tailOutput = arena.take<float>(tailPartitionSize * 2);
+            state.tailDelayLineReal = arena.take<float>(tailSpectraLength);
+            state.tailDelayLineImag = arena.take<float>(tailSpectraLength);
+            state.tailAccumulatorReal = arena.take<float>(tailNumBins);
+            state.tailAccumulatorImag = arena.take<float>(tailNumBins);
+            state.tailImpulseReal = tailSpectraReal[irChannel];
+            state.tailImpulseImag = tailSpectraImag[irChannel];
+        }
+    }
+
+    reset();
+}
+
+std::unique_ptr<PartitionedConvolver> PartitionedConvolver::createFromFile(const juce::File& file, double sampleRate, int numChannels)
+{
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0 || sampleRate <= 0.0)
+        return {};
+
+    const int numImpulseChannels = juce::jlimit(1, juce::jmax(1, numChannels), (int) reader->numChannels);
+    const int sourceLength = (int) juce::jmin(reader->lengthInSamples, (juce::int64) (maxImpulseSeconds * reader->sampleRate));
+
+    juce::AudioBuffer<float> impulse(numImpulseChannels, sourceLength);
+    reader->read(&impulse, 0, sourceLength, 0, true, numImpulseChannels > 1);
+
+    // Bring the IR to the processing rate
+    const double ratio = reader->sampleRate / sampleRate;
+
+    if (std::abs(ratio - 1.0) > 1.0e-6)
+    {
+        const int resampledLength = juce::jmax(1, (int) (sourceLength / ratio));
+        juce::AudioBuffer<float> resampled(numImpulseChannels, resampledLength);
+
+        for (int channel = 0; channel < numImpulseChannels; ++channel)
+        {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(ratio, impulse.getReadPointer(channel), resampled.getWritePointer(channel), resampledLength);
+        }
+
+        impulse = std::move(resampled);
+    }
+
+    // Unit energy per channel keeps IRs of very different lengths at a similar loudness
+    double energy = 0.0;
+
+    for (int channel = 0; channel < numImpulseChannels; ++channel)
+        for (int i = 0; i < impulse.getNumSamples(); ++i)
+            energy += (double) impulse.getSample(channel, i) * impulse.getSample(channel, i);
+
+    energy /= numImpulseChannels;
+
+    if (energy > 0.0)
+        impulse.applyGain((float) (1.0 / std::sqrt(energy)));
+
+    return std::make_unique<PartitionedConvolver>(impulse, numChannels);
+}
+
+//==============================================================================
+void PartitionedConvolver::reset() noexcept
+{
+    const int spectraLength = numHeadPartitions * numBins;
+    const int tailSpectraLength = numTailPartitions * tailNumBins;
+
+    for (auto& state : channels)
+    {
+        juce::FloatVectorOperations::clear(state.inputFrame, fftSize);
+        juce::FloatVectorOperations::clear(state.outputBlock, partitionSize);
+        juce::FloatVectorOperations::clear(state.delayLineReal, spectraLength);
+        juce::FloatVectorOperations::clear(state.delayLineImag, spectraLength);
+        juce::FloatVectorOperations::clear(state.nextReal, numBins);
+        juce::FloatVectorOperations::clear(state.nextImag, numBins);
+
+        if (numTailPartitions > 0)
+        {
+            juce::FloatVectorOperations::clear(state.tailInput, tailPartitionSize * 2);
+            juce::FloatVectorOperations::clear(state.tailWorkspace, tailFFTSize * 2);
+            juce::FloatVectorOperations::clear(state.tailOutput, tailPartitionSize * 2);
+            juce::FloatVectorOperations::clear(state.tailDelayLineReal, tailSpectraLength);
+            juce::FloatVectorOperations::clear(state.tailDelayLineImag, tailSpectraLength);
+            juce::FloatVectorOperations::clear(state.tailAccumulatorReal, tailNumBins);
+            juce::FloatVectorOperations::clear(state.tailAccumulatorImag, tailNumBins);
+        }
+    }
+
+    blockPosition = 0;
+    delayLinePosition = 0;
+    headStepsDone = 0;
+
+    // Nothing is being computed yet, so the tail starts with its steps already done
+    tailPosition = 0;
+    tailDelayLinePosition = 0;
+    tailStepsDone = (numTailPartitions + 2) * (int) channels.size();
+    tailInputHalf = 0;
+    tailOutputHalf = 0;
+}
+
+void PartitionedConvolver::process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept
+{
+    const int channelsToProcess = juce::jmin((int) channels.size(), buffer.getNumChannels());
+    const bool hasTail = numTailPartitions > 0;
+    const int numHeadSteps = numHeadPartitions - 1;
+    const int numTailSteps = (numTailPartitions + 2) * (int) channels.size();
+
+    while (numSamples > 0)
+    {
+        // Work in spans that end either at the block end or at the next partition boundary.
+        // Tail boundaries fall on partition boundaries too.
+        const int spanLength = juce::jmin(numSamples, partitionSize - blockPosition);
+
+        for (int channel = 0; channel < channelsToProcess; ++channel)
+        {
+            auto& state = channels[(size_t) channel];
+            float* io = buffer.getWritePointer(channel, startSample);
+
+            juce::FloatVectorOperations::copy(state.inputFrame + partitionSize + blockPosition, io, spanLength);
+
+            if (hasTail)
+                juce::FloatVectorOperations::copy(state.tailInput + tailInputHalf * tailPartitionSize + tailPosition, io, spanLength);
+
+            juce::FloatVectorOperations::copy(io, state.outputBlock + blockPosition, spanLength);
+
+            if (hasTail)
+                juce::FloatVectorOperations::add(io, state.tailOutput + tailOutputHalf * tailPartitionSize + tailPosition, spanLength);
+        }
+
+        blockPosition += spanLength;
+        startSample += spanLength;
+        numSamples -= spanLength;
+
+        // Each segment's deferred work keeps pace with its position in the period, so
+        // every callback does its share and a boundary only finishes what is left
+        runHeadSteps(channelsToProcess, numHeadSteps * blockPosition / partitionSize);
+
+        if (hasTail)
+        {
+            tailPosition += spanLength;
+            runTailSteps(channelsToProcess, numTailSteps * tailPosition / tailPartitionSize);
+        }
+
+        if (blockPosition == partitionSize)
+        {
+            delayLinePosition = delayLinePosition + 1 < numHeadPartitions ? delayLinePosition + 1 : 0;
+
+            for (int channel = 0; channel < channelsToProcess; ++channel)
+                finishHeadBlock(channels[(size_t) channel]);
+
+            blockPosition = 0;
+            headStepsDone = 0;
+        }
+
+        if (hasTail && tailPosition == tailPartitionSize)
+        {
+            // The block computed over the last period starts playing, and the block just
+            // collected is computed over the next one
+            tailDelayLinePosition = tailDelayLinePosition + 1 < numTailPartitions ? tailDelayLinePosition + 1 : 0;
+
+            for (int channel = 0; channel < channelsToProcess; ++channel)
+                startTailBlock(channels[(size_t) channel]);
+
+            tailInputHalf ^= 1;
+            tailOutputHalf ^= 1;
+            tailPosition = 0;
+            tailStepsDone = 0;
+        }
+    }
+}
+
+void PartitionedConvolver::runHeadSteps(int numChannels, int targetStep) noexcept
+{
+    for (; headStepsDone < targetStep; ++headStepsDone)
+    {
+        // Partition p of the next output block meets the input spectrum p blocks older than
+        // that block's own, which is p - 1 slots behind the newest one
+        const int partition = headStepsDone + 1;
+        const int slot = (delayLinePosition - partition + 1 + numHeadPartitions) % numHeadPartitions;
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            auto& state = channels[(size_t) channel];
+
+            SpectralKernels::complexMultiplyAccumulate(state.delayLineReal + slot * numBins, state.delayLineImag + slot * numBins,
+                                                       state.impulseReal + partition * numBins, state.impulseImag + partition * numBins,
+                                                       state.nextReal, state.nextImag, numBins);
+        }
+    }
+}
+
+void PartitionedConvolver::finishHeadBlock(ChannelState& state) noexcept
+{
+    // Transform the last two input blocks and store the spectrum as the newest delay-line entry
+    juce::FloatVectorOperations::copy(fftWorkspace, state.inputFrame, fftSize);
+    fft.performRealOnlyForwardTransform(fftWorkspace, true);
+
+    float* newestReal = state.delayLineReal + delayLinePosition * numBins;
+    float* newestImag = state.delayLineImag + delayLinePosition * numBins;
+    unpackSpectrum(fftWorkspace, newestReal, newestImag, numBins);
+
+    // The current block becomes the previous one for the next step
+    juce::FloatVectorOperations::copy(state.inputFrame, state.inputFrame + partitionSize, partitionSize);
+
+    // Partition 0 is the only one that needs the newest spectrum; the others were
+    // accumulated over the period that just ended
+    SpectralKernels::complexMultiplyAccumulate(newestReal, newestImag, state.impulseReal, state.impulseImag,
+                                               state.nextReal, state.nextImag, numBins);
+
+    packSpectrum(state.nextReal, state.nextImag, fftWorkspace, numBins);
+    fft.performRealOnlyInverseTransform(fftWorkspace);
+
+    // Overlap-save: only the second half is free of circular wrap-around
+    juce::FloatVectorOperations::copy(state.outputBlock, fftWorkspace + partitionSize, partitionSize);
+
+    juce::FloatVectorOperations::clear(state.nextReal, numBins);
+    juce::FloatVectorOperations::clear(state.nextImag, numBins);
+}
+
+void PartitionedConvolver::runTailSteps(int numChannels, int targetStep) noexcept
+{
+    // Each channel takes its own steps, so one callback never has to run every channel's FFT
+    const int stepsPerStage = (int) channels.size();
+    const int computedHalf = tailOutputHalf ^ 1;
+
+    for (; tailStepsDone < targetStep; ++tailStepsDone)
+    {
+        const int stage = tailStepsDone / stepsPerStage;
+        const int channel = tailStepsDone % stepsPerStage;
+
+        if (channel >= numChannels)
+            continue;
+
+        auto& state = channels[(size_t) channel];
+
+        if (stage == 0)
+        {
+            tailFFT.performRealOnlyForwardTransform(state.tailWorkspace, true);
+            unpackSpectrum(state.tailWorkspace,
+                           state.tailDelayLineReal + tailDelayLinePosition * tailNumBins,
+                           state.tailDelayLineImag + tailDelayLinePosition * tailNumBins, tailNumBins);
+
+            juce::FloatVectorOperations::clear(state.tailAccumulatorReal, tailNumBins);
+            juce::FloatVectorOperations::clear(state.tailAccumulatorImag, tailNumBins);
+        }
+        else if (stage <= numTailPartitions)
+        {
+            // Tail partition p meets the input spectrum from p tail blocks ago
+            const int partition = stage - 1;
+            const int slot = (tailDelayLinePosition - partition + numTailPartitions) % numTailPartitions;
+
+            SpectralKernels::complexMultiplyAccumulate(state.tailDelayLineReal + slot * tailNumBins, state.tailDelayLineImag + slot * tailNumBins,
+                                                       state.tailImpulseReal + partition * tailNumBins, state.tailImpulseImag + partition * tailNumBins,
+                                                       state.tailAccumulatorReal, state.tailAccumulatorImag, tailNumBins);
+        }
+        else
+        {
+            packSpectrum(state.tailAccumulatorReal, state.tailAccumulatorImag, state.tailWorkspace, tailNumBins);
+            tailFFT.performRealOnlyInverseTransform(state.tailWorkspace);
+
+            juce::FloatVectorOperations::copy(state.tailOutput + computedHalf * tailPartitionSize,
+                                              state.tailWorkspace + tailPartitionSize, tailPartitionSize);
+        }
+    }
+}
+
+void PartitionedConvolver::startTailBlock(ChannelState& state) noexcept
+{
+    // The older input block followed by the one just collected, which the next block overwrites
+    const int previousHalf = tailInputHalf ^ 1;
+
+    juce::FloatVectorOperations::copy(state.tailWorkspace, state.tailInput + previousHalf * tailPartitionSize, tailPartitionSize);
+    juce::FloatVectorOperations::copy(state.tailWorkspace + tailPartitionSize, state.tailInput + tailInputHalf * tailPartitionSize, tailPartitionSize);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SpectralWorkArena.h"
+
+//==============================================================================
+/**
+ * PartitionedConvolver
+ * Non-uniformly partitioned overlap-save convolution for long impulse responses.
+ *
+ * The impulse response is split into two segments whose partition spectra are
+ * computed once, when the convolver is built:
+ *
+ * - The head covers the first tailOffset samples in partitionSize blocks. Only
+ *   partition 0 needs the newest input spectrum, so a partition boundary costs
+ *   one forward FFT, one multiply-accumulate and one inverse FFT. Partitions
+ *   1 and up are accumulated into the following output block in equal shares
+ *   over the callbacks of the period before it.
+ * - The tail covers the rest in tailPartitionSize blocks. It starts late enough
+ *   that each tail block can be computed during the tail block after it, so its
+ *   forward FFT, multiply-accumulates and inverse FFT are all spread evenly over
+ *   that period.
+ *
+ * The tail needs about an eighth of the multiply-accumulates that
+ * partitionSize blocks would, and the work per callback stays close to flat
+ * whatever the host block size. The latency is partitionSize.
+ *
+ * All memory is allocated by the constructor, so a convolver is built on the
+ * message thread and handed to the audio thread whole.
+ */
+class PartitionedConvolver
+{
+public:
+    //==============================================================================
+    static constexpr int partitionOrder = 9;
+    static constexpr int partitionSize = 1 << partitionOrder;   // also the latency
+    static constexpr int tailPartitionOrder = 12;
+    static constexpr int tailPartitionSize = 1 << tailPartitionOrder;
+
+    // The first IR sample the tail covers. A tail block is played two tail blocks after
+    // it starts arriving, which is this far into the IR once the head latency is added.
+    static constexpr int tailOffset = tailPartitionSize * 2 - partitionSize;
+
+    static constexpr double maxImpulseSeconds = 10.0;
+
+    // Convolves numChannels of audio; input channel c uses IR channel c modulo the IR's channel count
+    PartitionedConvolver(const juce::AudioBuffer<float>& impulseResponse, int numChannels);
+
+    // Reads an impulse response from disk, resampled to sampleRate and normalised
+    // to unit energy. Returns nullptr if the file can't be read.
+    static std::unique_ptr<PartitionedConvolver> createFromFile(const juce::File& file, double sampleRate, int numChannels);
+
+    //==============================================================================
+    void reset() noexcept;
+
+    // Replaces numSamples of buffer, starting at startSample, with the convolved signal
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples) noexcept;
+
+    int getLatencyInSamples() const noexcept { return partitionSize; }
+    int getImpulseLength() const noexcept { return impulseLength; }
+    int getNumPartitions() const noexcept { return numHeadPartitions + numTailPartitions; }
+
+private:
+    //==============================================================================
+    static constexpr int fftSize = partitionSize * 2;
+    static constexpr int numBins = partitionSize + 1;
+    static constexpr int tailFFTSize = tailPartitionSize * 2;
+    static constexpr int tailNumBins = tailPartitionSize + 1;
+
+    struct ChannelState
+    {
+        // Head
+        float* inputFrame = nullptr;        // fftSize: the previous and the current input block
+        float* outputBlock = nullptr;       // partitionSize: output of the last partition step
+        float* delayLineReal = nullptr;     // numHeadPartitions * numBins
+        float* delayLineImag = nullptr;     // numHeadPartitions * numBins
+        float* nextReal = nullptr;          // numBins: partitions 1 and up of the next output block
+        float* nextImag = nullptr;          // numBins
+        const float* impulseReal = nullptr; // numHeadPartitions * numBins, shared between channels
+        const float* impulseImag = nullptr;
+
+        // Tail
+        float* tailInput = nullptr;         // 2 * tailPartitionSize: two input blocks, filled alternately
+        float* tailWorkspace = nullptr;     // tailFFTSize * 2: the block being computed
+        float* tailOutput = nullptr;        // 2 * tailPartitionSize: the block playing and the block being computed
+        float* tailDelayLineReal = nullptr; // numTailPartitions * tailNumBins
+        float* tailDelayLineImag = nullptr;
+        float* tailAccumulatorReal = nullptr;   // tailNumBins
+        float* tailAccumulatorImag = nullptr;
+        const float* tailImpulseReal = nullptr; // numTailPartitions * tailNumBins, shared between channels
+        const float* tailImpulseImag = nullptr;
+    };
+
+    void runHeadSteps(int numChannels, int targetStep) noexcept;
+    void finishHeadBlock(ChannelState& state) noexcept;
+    void runTailSteps(int numChannels, int targetStep) noexcept;
+    void startTailBlock(ChannelState& state) noexcept;
+
+    //==============================================================================
+    juce::dsp::FFT fft { partitionOrder + 1 };
+    juce::dsp::FFT tailFFT { tailPartitionOrder + 1 };
+    SpectralWorkArena arena;
+    std::vector<ChannelState> channels;
+
+    float* fftWorkspace = nullptr;          // fftSize * 2, in-place real FFT
+
+    int impulseLength = 0;
+    int numHeadPartitions = 0;
+    int numTailPartitions = 0;
+
+    int blockPosition = 0;                  // samples collected towards the next partition step
+    int delayLinePosition = 0;              // slot holding the newest input spectrum
+    int headStepsDone = 0;                  // head partitions accumulated into the next output block
+
+    int tailPosition = 0;                   // samples collected towards the next tail block
+    int tailDelayLinePosition = 0;
+    int tailStepsDone = 0;                  // per channel: forward FFT, one per tail partition, inverse FFT
+    int tailInputHalf = 0;                  // tailInput half being filled
+    int tailOutputHalf = 0;                 // tailOutput half being played
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PartitionedConvolver)
+};
@@ -1,6 +1,23 @@
 ﻿#include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+namespace
+{
+    // Renders the given drawing function into an image at the physical resolution
+    // of the target context, so drawing the image back is a 1:1 copy
+    template <typename DrawFunction>
+    juce::Image renderToImage(juce::Image::PixelFormat format, int width, int height, float scale, DrawFunction&& draw)
+    {
+        juce::Image image(format, juce::jmax(1, juce::roundToInt(width * scale)), juce::jmax(1, juce::roundToInt(height * scale)), true);
+
+        juce::Graphics g(image);
+        g.addTransform(juce::AffineTransform::scale(scale));
+        draw(g);
+
+        return image;
+    }
+}
+
 //==============================================================================
 // Custom Look and Feel implementation
 NewVerbTk1AudioProcessorEditor::CustomLookAndFeel::CustomLookAndFeel()
@@ -13,11 +30,37 @@ NewVerbTk1AudioProcessorEditor::CustomLookAndFeel::CustomLookAndFeel()
 void NewVerbTk1AudioProcessorEditor::CustomLookAndFeel::drawRotarySlider(juce::Graphics& g, int x, int y, int width, int height,
     float sliderPos, const float rotaryStartAngle,
     const float rotaryEndAngle, juce::Slider& slider)
+{
+    juce::ignoreUnused(slider);
+
+    // Knobs are blitted from images rendered once per size, display scale and value bucket
+    const int bucket = juce::roundToInt(juce::jlimit(0.0f, 1.0f, sliderPos) * (knobCacheBuckets - 1));
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+    const KnobCacheKey key { width, height, juce::roundToInt(scale * 100.0f), bucket,
+                             juce::roundToInt(rotaryStartAngle * 1000.0f), juce::roundToInt(rotaryEndAngle * 1000.0f) };
+
+    if (knobCache.size() >= maxCachedKnobs && knobCache.find(key) == knobCache.end())
+        knobCache.clear();
+
+    auto& image = knobCache[key];
+
+    if (!image.isValid())
+        image = renderToImage(juce::Image::ARGB, width, height, scale, [&](juce::Graphics& knob)
+        {
+            drawKnob(knob, width, height, bucket / float(knobCacheBuckets - 1), rotaryStartAngle, rotaryEndAngle);
+        });
+
+    g.drawImage(image, juce::Rectangle<int>(x, y, width, height).toFloat());
+}
+
+void NewVerbTk1AudioProcessorEditor::CustomLookAndFeel::drawKnob(juce::Graphics& g, int width, int height, float sliderPos,
+    float rotaryStartAngle, float rotaryEndAngle)
 {
     // Calculate useful values
     const float radius = juce::jmin(width / 2, height / 2) - 4.0f;
-    const float centerX = x + width * 0.5f;
-    const float centerY = y + height * 0.5f;
+    const float centerX = width * 0.5f;
+    const float centerY = height * 0.5f;
     const float angle = rotaryStartAngle + sliderPos * (rotaryEndAngle - rotaryStartAngle);
 
     // Draw outline circle
@@ -45,9 +88,11 @@ void NewVerbTk1AudioProcessorEditor::CustomLookAndFeel::drawRotarySlider(juce::G
 
 //==============================================================================
 // Spectrogram Component Implementation
-NewVerbTk1AudioProcessorEditor::SpectrogramComponent::SpectrogramComponent(NewVerbTk1AudioProcessor& p)
-    : processor(p)
+NewVerbTk1AudioProcessorEditor::SpectrogramComponent::SpectrogramComponent()
 {
+    // paint() fills the whole component with the ring image
+    setOpaque(true);
+
     // Initialize color gradient for spectrogram
     gradientColours[0] = juce::Colours::black;
     gradientColours[1] = juce::Colour(0, 0, 80);
@@ -56,18 +101,53 @@ NewVerbTk1AudioProcessorEditor::SpectrogramComponent::SpectrogramComponent(NewVe
     gradientColours[4] = juce::Colour(0, 160, 200);
     gradientColours[5] = juce::Colours::white;
 
-    // Create spectrogram image buffer with transparency
-    spectrogramImage = juce::Image(juce::Image::RGB, 512, 256, true);
+    // Build the colour table: the gradient sampled at 256 evenly spaced levels
+    for (int i = 0; i < (int) colourTable.size(); ++i)
+    {
+        const float pos = i * 5.0f / 255.0f;
+        const int index = juce::jmin(4, static_cast<int>(pos));
+
+        colourTable[(size_t) i] = gradientColours[index].interpolatedWith(gradientColours[index + 1], pos - index).getPixelARGB();
+    }
+
+    // level = 0.35 * log10(1 + 100 * magnitude), so solve for the magnitude at
+    // which each colour step begins and replace the log with a table search
+    for (int i = 0; i < (int) levelThresholds.size(); ++i)
+    {
+        const float level = (i + 1) / 255.0f;
+        levelThresholds[(size_t) i] = (std::pow(10.0f, level / 0.35f) - 1.0f) / 100.0f;
+    }
 }
 
 void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::paint(juce::Graphics& g)
 {
-    // Draw background
-    g.fillAll(juce::Colours::black);
+    // The ring image covers every pixel, so there is no background fill.
+    // Draw it unrolled: the oldest column sits at writeColumn
+    const int imageWidth = spectrogramImage.getWidth();
+    const int imageHeight = spectrogramImage.getHeight();
 
-    // Draw the spectrogram image
-    g.drawImage(spectrogramImage, getLocalBounds().toFloat());
+    if (writeColumn < imageWidth)
+        g.drawImage(spectrogramImage, 0, 0, imageWidth - writeColumn, imageHeight,
+            writeColumn, 0, imageWidth - writeColumn, imageHeight);
 
+    if (writeColumn > 0)
+        g.drawImage(spectrogramImage, imageWidth - writeColumn, 0, writeColumn, imageHeight,
+            0, 0, writeColumn, imageHeight);
+
+    // The grid, labels and border are the same every frame, so they come from a cached overlay
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+    if (!overlayImage.isValid() || scale != overlayScale)
+    {
+        overlayImage = renderToImage(juce::Image::ARGB, getWidth(), getHeight(), scale, [this](juce::Graphics& overlay) { drawOverlay(overlay); });
+        overlayScale = scale;
+    }
+
+    g.drawImage(overlayImage, getLocalBounds().toFloat());
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::drawOverlay(juce::Graphics& g)
+{
     // Draw frequency grid lines and labels
     g.setColour(juce::Colours::darkgrey.withAlpha(0.5f));
 
@@ -99,70 +179,295 @@ void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::paint(juce::Graphics&
     g.drawRect(getLocalBounds(), 1);
 }
 
-void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::update()
+void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::resized()
 {
-    // Get magnitude data from the processor
-    const float* spectralData = processor.getSpectralMagnitudeBuffer();
-    const int fftSize = processor.getFFTSize();
+    overlayImage = {};
 
-    // Create a new image for the updated spectrogram
-    juce::Image newImage(juce::Image::RGB, getWidth(), getHeight(), true);
-    juce::Graphics g(newImage);
+    if (spectrogramImage.getWidth() == getWidth() && spectrogramImage.getHeight() == getHeight())
+        return;
 
-    // Copy existing image, shifted left
-    g.drawImage(spectrogramImage, -1, 0, getWidth() - 1, getHeight(),
-        1, 0, getWidth() - 1, getHeight());
+    // The image maps one pixel to one pixel, so it is only rebuilt when the size changes
+    spectrogramImage = juce::Image(juce::Image::RGB, juce::jmax(1, getWidth()), juce::jmax(1, getHeight()), true);
+    writeColumn = 0;
+    rowMapNumBins = 0;
+}
 
-    // Draw the new column of data
-    const int numBins = fftSize / 2;
-    const float height = getHeight();
+void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::rebuildRowMap(int numBins)
+{
+    const int height = spectrogramImage.getHeight();
+    rowToBin.resize((size_t) height);
 
     for (int y = 0; y < height; ++y)
     {
         // Map y coordinate to FFT bin (logarithmic scale)
         float binPosition = std::pow(static_cast<float>(y) / height, 2.5f) * numBins;
-        int binIndex = juce::jlimit(0, numBins - 1, static_cast<int>(binPosition));
+        rowToBin[(size_t) y] = juce::jlimit(0, numBins - 1, static_cast<int>(binPosition));
+    }
+
+    rowMapNumBins = numBins;
+}
 
-        // Get magnitude and convert to decibels with some scaling to improve visualization
-        float magnitude = spectralData[binIndex];
-        float level = juce::jlimit(0.0f, 1.0f, 0.35f * std::log10(1.0f + 100.0f * magnitude));
+int NewVerbTk1AudioProcessorEditor::SpectrogramComponent::getColourIndex(float magnitude) const noexcept
+{
+    return static_cast<int>(std::upper_bound(levelThresholds.begin(), levelThresholds.end(), magnitude) - levelThresholds.begin());
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrogramComponent::update(const SpectrumTripleBuffer::Frame& frame)
+{
+    const float* spectralData = frame.getTrace(SpectrumAnalyser::outputTrace);
+    const int numBins = frame.numBins - 1;
 
-        // Map level to color using gradient
-        juce::Colour color;
+    if (numBins < 1 || !spectrogramImage.isValid())
+        return;
 
-        if (level <= 0.0f)
-            color = gradientColours[0];
-        else if (level >= 1.0f)
-            color = gradientColours[5];
+    if (numBins != rowMapNumBins || (int) rowToBin.size() != spectrogramImage.getHeight())
+        rebuildRowMap(numBins);
+
+    // Write the new column straight into the image
+    const int height = spectrogramImage.getHeight();
+    juce::Image::BitmapData bitmap(spectrogramImage, writeColumn, 0, 1, height, juce::Image::BitmapData::writeOnly);
+    const bool isRGB = bitmap.pixelFormat == juce::Image::RGB;
+
+    for (int y = 0; y < height; ++y)
+    {
+        const auto& colour = colourTable[(size_t) getColourIndex(spectralData[rowToBin[(size_t) y]])];
+        auto* pixel = bitmap.getPixelPointer(0, height - 1 - y);
+
+        if (isRGB)
+            reinterpret_cast<juce::PixelRGB*>(pixel)->set(colour);
         else
-        {
-            float pos = level * 5.0f;
-            int index = static_cast<int>(pos);
-            float alpha = pos - index;
+            reinterpret_cast<juce::PixelARGB*>(pixel)->set(colour);
+    }
+
+    writeColumn = (writeColumn + 1) % spectrogramImage.getWidth();
 
-            color = gradientColours[index].interpolatedWith(gradientColours[index + 1], alpha);
+    // Trigger a repaint
+    repaint();
+}
+
+//==============================================================================
+// Spectrum Curve Component Implementation
+NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::SpectrumCurveComponent(NewVerbTk1AudioProcessor& p)
+    : processor(p)
+{
+    setInterceptsMouseClicks(false, false);
+}
+
+float NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::getFrequencyAtX(float x) const noexcept
+{
+    return minFrequency * std::pow(maxFrequency / minFrequency, x / (float) juce::jmax(1, getWidth()));
+}
+
+float NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::getXForFrequency(float frequency) const noexcept
+{
+    return (float) getWidth() * std::log(frequency / minFrequency) / std::log(maxFrequency / minFrequency);
+}
+
+float NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::getYForMagnitude(float magnitude) const noexcept
+{
+    // A full-scale sine reads 1.0, i.e. the top of the display
+    const float decibels = juce::Decibels::gainToDecibels(magnitude, minDecibels);
+    return juce::jmap(decibels, minDecibels, 0.0f, (float) getHeight(), 0.0f);
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::buildPath(juce::Path& path, const float* magnitudes, int numBins, float binWidth) const
+{
+    path.clear();
+
+    // One point per pixel column. Bins sharing a column contribute their largest
+    // magnitude, and columns below the first bin are bridged by the line to it.
+    int bin = juce::jmax(1, (int) std::ceil(minFrequency / binWidth));
+    bool started = false;
+
+    for (int x = 0; x < getWidth() && bin < numBins; ++x)
+    {
+        const float columnEnd = getFrequencyAtX((float) (x + 1));
+
+        if ((float) bin * binWidth >= columnEnd)
+            continue;
+
+        float magnitude = 0.0f;
+
+        while (bin < numBins && (float) bin * binWidth < columnEnd)
+            magnitude = juce::jmax(magnitude, magnitudes[bin++]);
+
+        const float y = getYForMagnitude(magnitude);
+
+        if (started)
+        {
+            path.lineTo((float) x, y);
+        }
+        else
+        {
+            path.startNewSubPath((float) x, y);
+            started = true;
         }
+    }
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::update(const SpectrumTripleBuffer::Frame& frame)
+{
+    const double sampleRate = processor.getSampleRate();
+
+    if (frame.numBins < 2 || frame.fftSize <= 0 || sampleRate <= 0.0)
+        return;
+
+    maxFrequency = juce::jmin(20000.0f, (float) sampleRate * 0.5f);
+    const float binWidth = (float) sampleRate / (float) frame.fftSize;
+
+    buildPath(inputPath, frame.getTrace(SpectrumAnalyser::inputTrace), frame.numBins, binWidth);
+    buildPath(outputPath, frame.getTrace(SpectrumAnalyser::outputTrace), frame.numBins, binWidth);
+
+    if (peakTraceVisible)
+        buildPath(peakPath, frame.getTrace(SpectrumAnalyser::outputPeakTrace), frame.numBins, binWidth);
+
+    repaint();
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::setPeakTraceVisible(bool shouldBeVisible)
+{
+    peakTraceVisible = shouldBeVisible;
+    peakPath.clear();
+    repaint();
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::paint(juce::Graphics& g)
+{
+    const auto bounds = getLocalBounds().toFloat();
+
+    g.setColour(juce::Colour(30, 30, 50));
+    g.fillRect(bounds);
+
+    // Grid: every 24 dB, and the decades from 100 Hz
+    g.setColour(juce::Colours::darkgrey.withAlpha(0.5f));
+
+    for (float decibels = -24.0f; decibels > minDecibels; decibels -= 24.0f)
+        g.drawHorizontalLine(juce::roundToInt(juce::jmap(decibels, minDecibels, 0.0f, bounds.getHeight(), 0.0f)), 0.0f, bounds.getWidth());
 
-        // Draw the pixel
-        g.setColour(color);
-        g.setColour(color);
-        g.fillRect(getWidth() - 1, static_cast<int>(height - 1 - y), 1, 1);
+    g.setFont(11.0f);
+
+    for (float frequency = 100.0f; frequency < maxFrequency; frequency *= 10.0f)
+    {
+        const int x = juce::roundToInt(getXForFrequency(frequency));
+        g.setColour(juce::Colours::darkgrey.withAlpha(0.5f));
+        g.drawVerticalLine(x, 0.0f, bounds.getHeight());
+
+        g.setColour(juce::Colours::white.withAlpha(0.6f));
+        g.drawText(frequency < 1000.0f ? juce::String((int) frequency) + " Hz" : juce::String((int) frequency / 1000) + " kHz",
+            x + 3, getHeight() - 16, 60, 14, juce::Justification::left);
     }
 
-    // Update the spectrogram image
-    spectrogramImage = newImage;
+    // Input behind, output in front, its peak hold on top
+    g.setColour(juce::Colours::grey.withAlpha(0.6f));
+    g.strokePath(inputPath, juce::PathStrokeType(1.0f));
 
-    // Trigger a repaint
+    g.setColour(juce::Colour(0, 160, 200));
+    g.strokePath(outputPath, juce::PathStrokeType(1.5f));
+
+    g.setColour(juce::Colours::white.withAlpha(0.7f));
+    g.strokePath(peakPath, juce::PathStrokeType(1.0f));
+
+    // Legend
+    g.setFont(11.0f);
+    g.setColour(juce::Colours::grey);
+    g.drawText("In", getWidth() - 90, 4, 25, 14, juce::Justification::right);
+    g.setColour(juce::Colour(0, 160, 200));
+    g.drawText("Out", getWidth() - 62, 4, 25, 14, juce::Justification::right);
+    g.setColour(juce::Colours::white.withAlpha(0.7f));
+    g.drawText("Peak", getWidth() - 34, 4, 30, 14, juce::Justification::right);
+
+    g.setColour(juce::Colours::darkgrey);
+    g.drawRect(getLocalBounds(), 1);
+}
+
+void NewVerbTk1AudioProcessorEditor::SpectrumCurveComponent::resized()
+{
+    // The paths are in pixels, so they are rebuilt from the next frame
+    inputPath.clear();
+    outputPath.clear();
+    peakPath.clear();
+}
+
+//==============================================================================
+// Load Meter Component Implementation
+NewVerbTk1AudioProcessorEditor::LoadMeterComponent::LoadMeterComponent(ProcessLoadMonitor& m)
+    : monitor(m), previousSnapshot(m.getSnapshot())
+{
+}
+
+void NewVerbTk1AudioProcessorEditor::LoadMeterComponent::update()
+{
+    // Averaging over a tenth of a second keeps the number readable
+    const double now = juce::Time::getMillisecondCounterHiRes();
+
+    if (now - lastRefreshTime < refreshIntervalMs)
+        return;
+
+    lastRefreshTime = now;
+
+    const auto snapshot = monitor.getSnapshot();
+    const float load = snapshot.getAverageLoadSince(previousSnapshot);
+    previousSnapshot = snapshot;
+
+    if (load == displayedLoad && snapshot.peakLoad == displayedPeak && snapshot.numOverruns == displayedOverruns)
+        return;
+
+    displayedLoad = load;
+    displayedPeak = snapshot.peakLoad;
+    displayedOverruns = snapshot.numOverruns;
+    repaint();
+}
+
+void NewVerbTk1AudioProcessorEditor::LoadMeterComponent::paint(juce::Graphics& g)
+{
+    auto bounds = getLocalBounds().toFloat();
+
+    g.setColour(juce::Colour(30, 30, 50));
+    g.fillRoundedRectangle(bounds, 3.0f);
+
+    // Green up to half the deadline, orange up to the deadline, red beyond it
+    const auto barColour = displayedLoad < 0.5f ? juce::Colour(65, 200, 120)
+                         : displayedLoad < 1.0f ? juce::Colours::orange
+                                                : juce::Colours::red;
+
+    g.setColour(barColour.withAlpha(0.7f));
+    g.fillRoundedRectangle(bounds.withWidth(bounds.getWidth() * juce::jlimit(0.0f, 1.0f, displayedLoad)), 3.0f);
+
+    // Peak marker
+    const float peakX = bounds.getWidth() * juce::jlimit(0.0f, 1.0f, displayedPeak);
+    g.setColour(juce::Colours::white.withAlpha(0.8f));
+    g.drawVerticalLine(juce::jmin(juce::roundToInt(peakX), getWidth() - 1), 0.0f, bounds.getHeight());
+
+    juce::String text = "CPU " + juce::String(juce::roundToInt(displayedLoad * 100.0f)) + "%";
+
+    if (displayedOverruns > 0)
+        text << "  " << juce::String((juce::int64) displayedOverruns) << " over";
+
+    g.setColour(juce::Colours::white);
+    g.setFont(11.0f);
+    g.drawText(text, getLocalBounds().reduced(4, 0), juce::Justification::centredLeft);
+}
+
+void NewVerbTk1AudioProcessorEditor::LoadMeterComponent::mouseDown(const juce::MouseEvent& event)
+{
+    juce::ignoreUnused(event);
+
+    monitor.reset();
+    displayedPeak = 0.0f;
+    displayedOverruns = 0;
     repaint();
 }
 
 //==============================================================================
 NewVerbTk1AudioProcessorEditor::NewVerbTk1AudioProcessorEditor(NewVerbTk1AudioProcessor& p, juce::AudioProcessorValueTreeState& vts)
-    : AudioProcessorEditor(&p), audioProcessor(p), valueTreeState(vts), spectrogramDisplay(p)
+    : AudioProcessorEditor(&p), audioProcessor(p), valueTreeState(vts), spectrumCurves(p), loadMeter(p.getLoadMonitor())
 {
     // Set custom look and feel
     setLookAndFeel(&customLookAndFeel);
 
+    // paint() covers every pixel with the cached background
+    setOpaque(true);
+
     // Set up title
     titleLabel.setText("NewVerbTk1 - Spectral Sculptor", juce::dontSendNotification);
     titleLabel.setFont(juce::Font(24.0f, juce::Font::bold));
@@ -188,6 +493,27 @@ NewVerbTk1AudioProcessorEditor::NewVerbTk1AudioProcessorEditor(NewVerbTk1AudioPr
     freezeLabel.setJustificationType(juce::Justification::centred);
     addAndMakeVisible(freezeLabel);
 
+    // Set up the STFT resolution selectors
+    setupChoiceBox(fftSizeBox, fftSizeLabel, "FFT Size", "fft_size");
+    setupChoiceBox(overlapBox, overlapLabel, "Overlap", "overlap");
+
+    lowLatencyButton.setButtonText("Hybrid FFT");
+    addAndMakeVisible(lowLatencyButton);
+
+    // Set up the convolution controls
+    convMixSlider.setSliderStyle(juce::Slider::LinearHorizontal);
+    convMixSlider.setTextBoxStyle(juce::Slider::TextBoxRight, false, 50, 20);
+    convMixSlider.setColour(juce::Slider::textBoxOutlineColourId, juce::Colours::transparentBlack);
+    addAndMakeVisible(convMixSlider);
+
+    convMixLabel.setText("IR Mix", juce::dontSendNotification);
+    convMixLabel.attachToComponent(&convMixSlider, true);
+    addAndMakeVisible(convMixLabel);
+
+    loadImpulseButton.onClick = [this] { chooseImpulseResponse(); };
+    updateImpulseButtonText();
+    addAndMakeVisible(loadImpulseButton);
+
     // Create parameter attachments
     wetDryAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(
         valueTreeState, "wet_dry", wetDrySlider);
@@ -207,25 +533,52 @@ NewVerbTk1AudioProcessorEditor::NewVerbTk1AudioProcessorEditor(NewVerbTk1AudioPr
         valueTreeState, "high_band", highBandSlider);
     freezeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(
         valueTreeState, "freeze", freezeButton);
+    fftSizeAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(
+        valueTreeState, "fft_size", fftSizeBox);
+    overlapAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ComboBoxAttachment>(
+        valueTreeState, "overlap", overlapBox);
+    lowLatencyAttachment = std::make_unique<juce::AudioProcessorValueTreeState::ButtonAttachment>(
+        valueTreeState, "low_latency", lowLatencyButton);
+    convMixAttachment = std::make_unique<juce::AudioProcessorValueTreeState::SliderAttachment>(
+        valueTreeState, "conv_mix", convMixSlider);
 
     // Add spectrogram component
     addAndMakeVisible(spectrogramDisplay);
+    addAndMakeVisible(loadMeter);
+
+    // Set up the analyser view and its settings
+    addAndMakeVisible(spectrumCurves);
+    setupAnalyserControls();
 
     // Set initial window size
-    setSize(700, 500);
+    setSize(700, 680);
 
-    // Start timer for GUI updates
-    startTimerHz(30);
+    // Ask the processor for spectrum frames; refreshDisplay() pauses this while hidden
+    audioProcessor.setSpectrumPublishingEnabled(true);
 }
 
 NewVerbTk1AudioProcessorEditor::~NewVerbTk1AudioProcessorEditor()
 {
-    stopTimer();
+    audioProcessor.setSpectrumPublishingEnabled(false);
     setLookAndFeel(nullptr);
 }
 
 //==============================================================================
 void NewVerbTk1AudioProcessorEditor::paint(juce::Graphics& g)
+{
+    // Everything behind the controls is static, so it is rendered once per size and display scale
+    const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+    if (!backgroundImage.isValid() || scale != backgroundScale)
+    {
+        backgroundImage = renderToImage(juce::Image::RGB, getWidth(), getHeight(), scale, [this](juce::Graphics& background) { drawBackground(background); });
+        backgroundScale = scale;
+    }
+
+    g.drawImage(backgroundImage, getLocalBounds().toFloat());
+}
+
+void NewVerbTk1AudioProcessorEditor::drawBackground(juce::Graphics& g)
 {
     // Fill background with gradient
     g.fillAll(juce::Colours::black);
@@ -250,16 +603,26 @@ void NewVerbTk1AudioProcessorEditor::paint(juce::Graphics& g)
     // Frequency band section
     g.fillRoundedRectangle(20.0f, 200.0f, 320.0f, 120.0f, 10.0f);
 
+    // Engine section
+    g.fillRoundedRectangle(360.0f, 200.0f, 320.0f, 120.0f, 10.0f);
+
+    // Analyser settings section
+    g.fillRoundedRectangle(540.0f, 520.0f, 140.0f, 140.0f, 10.0f);
+
     // Draw section headers
     g.setColour(juce::Colours::white);
     g.setFont(16.0f);
     g.drawText("Main Parameters", 30, 60, 200, 20, juce::Justification::left, false);
     g.drawText("Frequency Bands", 30, 210, 200, 20, juce::Justification::left, false);
+    g.drawText("Engine", 370, 210, 200, 20, juce::Justification::left, false);
     g.drawText("Spectrogram", 30, 330, 200, 20, juce::Justification::left, false);
+    g.drawText("Analyser", 30, 495, 200, 20, juce::Justification::left, false);
 }
 
 void NewVerbTk1AudioProcessorEditor::resized()
 {
+    backgroundImage = {};
+
     // Position the title at the top
     titleLabel.setBounds(0, 10, getWidth(), 30);
 
@@ -298,8 +661,28 @@ void NewVerbTk1AudioProcessorEditor::resized()
     highBandSlider.setBounds(250, bandSectionY, sliderSize, sliderSize);
     highBandLabel.setBounds(250, bandSectionY + sliderSize, sliderSize, 20);
 
+    // Position resolution selectors
+    fftSizeBox.setBounds(390, bandSectionY + 30, 120, 24);
+    overlapBox.setBounds(530, bandSectionY + 30, 120, 24);
+
+    // Position convolution controls
+    loadImpulseButton.setBounds(530, bandSectionY - 23, 140, 22);
+    convMixSlider.setBounds(440, bandSectionY + 62, 230, 22);
+    lowLatencyButton.setBounds(440, bandSectionY + 90, 140, 22);
+
     // Position spectrogram
     spectrogramDisplay.setBounds(20, 350, 660, 130);
+
+    // Position the analyser curves and settings
+    const int analyserSectionY = 520;
+
+    spectrumCurves.setBounds(20, analyserSectionY, 510, 140);
+    analyserResolutionBox.setBounds(550, analyserSectionY + 28, 120, 24);
+    analyserAveragingBox.setBounds(550, analyserSectionY + 78, 120, 24);
+    analyserPeakHoldButton.setBounds(550, analyserSectionY + 110, 120, 22);
+
+    // Position load meter in the title bar
+    loadMeter.setBounds(570, 17, 110, 16);
 }
 
 void NewVerbTk1AudioProcessorEditor::setupRotarySlider(juce::Slider& slider, juce::Label& label, const juce::String& labelText)
@@ -318,13 +701,140 @@ void NewVerbTk1AudioProcessorEditor::setupRotarySlider(juce::Slider& slider, juc
     addAndMakeVisible(label);
 }
 
-void NewVerbTk1AudioProcessorEditor::updateSpectrogramDisplay()
+void NewVerbTk1AudioProcessorEditor::setupChoiceBox(juce::ComboBox& box, juce::Label& label, const juce::String& labelText, const juce::String& parameterID)
+{
+    // Item IDs start at 1, matching the indices ComboBoxAttachment expects
+    if (auto* choice = dynamic_cast<juce::AudioParameterChoice*>(valueTreeState.getParameter(parameterID)))
+        box.addItemList(choice->choices, 1);
+
+    addAndMakeVisible(box);
+
+    label.setText(labelText, juce::dontSendNotification);
+    label.setJustificationType(juce::Justification::centred);
+    label.attachToComponent(&box, false);
+    addAndMakeVisible(label);
+}
+
+void NewVerbTk1AudioProcessorEditor::setupAnalyserControls()
 {
-    spectrogramDisplay.update();
+    const auto settings = audioProcessor.getAnalyserSettings();
+
+    // Item ID = FFT order, so the ID is the setting
+    for (int order = SpectrumAnalyser::minFFTOrder; order <= SpectrumAnalyser::maxFFTOrder; ++order)
+        analyserResolutionBox.addItem(juce::String(1 << order), order);
+
+    analyserResolutionBox.setSelectedId(settings.fftOrder, juce::dontSendNotification);
+    analyserResolutionBox.onChange = [this] { applyAnalyserSettings(); };
+    addAndMakeVisible(analyserResolutionBox);
+
+    analyserResolutionLabel.setText("Resolution", juce::dontSendNotification);
+    analyserResolutionLabel.setJustificationType(juce::Justification::centred);
+    analyserResolutionLabel.attachToComponent(&analyserResolutionBox, false);
+    addAndMakeVisible(analyserResolutionLabel);
+
+    // Item ID = Averaging value + 1
+    analyserAveragingBox.addItemList({ "None", "Exponential", "RMS" }, 1);
+    analyserAveragingBox.setSelectedId((int) settings.averaging + 1, juce::dontSendNotification);
+    analyserAveragingBox.onChange = [this] { applyAnalyserSettings(); };
+    addAndMakeVisible(analyserAveragingBox);
+
+    analyserAveragingLabel.setText("Averaging", juce::dontSendNotification);
+    analyserAveragingLabel.setJustificationType(juce::Justification::centred);
+    analyserAveragingLabel.attachToComponent(&analyserAveragingBox, false);
+    addAndMakeVisible(analyserAveragingLabel);
+
+    analyserPeakHoldButton.setButtonText("Peak Hold");
+    analyserPeakHoldButton.setToggleState(settings.peakHold, juce::dontSendNotification);
+    analyserPeakHoldButton.onClick = [this] { applyAnalyserSettings(); };
+    addAndMakeVisible(analyserPeakHoldButton);
+
+    spectrumCurves.setPeakTraceVisible(settings.peakHold);
 }
 
-void NewVerbTk1AudioProcessorEditor::timerCallback()
+void NewVerbTk1AudioProcessorEditor::applyAnalyserSettings()
 {
-    // Regular updates for UI components
-    updateSpectrogramDisplay();
+    // Start from the current settings, so the ones without a control are kept
+    auto settings = audioProcessor.getAnalyserSettings();
+
+    settings.fftOrder = analyserResolutionBox.getSelectedId();
+    settings.averaging = static_cast<SpectrumAnalyser::Averaging>(analyserAveragingBox.getSelectedId() - 1);
+    settings.peakHold = analyserPeakHoldButton.getToggleState();
+
+    audioProcessor.setAnalyserSettings(settings);
+    spectrumCurves.setPeakTraceVisible(settings.peakHold);
+}
+
+void NewVerbTk1AudioProcessorEditor::chooseImpulseResponse()
+{
+    impulseChooser = std::make_unique<juce::FileChooser>("Load Impulse Response",
+        audioProcessor.getImpulseResponseFile(), "*.wav;*.aif;*.aiff;*.flac");
+
+    const auto flags = juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles;
+
+    impulseChooser->launchAsync(flags, [this](const juce::FileChooser& chooser)
+    {
+        const auto file = chooser.getResult();
+
+        if (file != juce::File() && !audioProcessor.loadImpulseResponse(file))
+            juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::WarningIcon, "Load Impulse Response",
+                "Couldn't read " + file.getFileName());
+
+        updateImpulseButtonText();
+    });
+}
+
+void NewVerbTk1AudioProcessorEditor::updateImpulseButtonText()
+{
+    const auto file = audioProcessor.getImpulseResponseFile();
+    loadImpulseButton.setButtonText(file == juce::File() ? juce::String("Load IR...") : file.getFileName());
+}
+
+bool NewVerbTk1AudioProcessorEditor::isVisibleOnScreen() const
+{
+    auto* peer = getPeer();
+
+    // ComponentPeer::isShowing() is false for a window the OS reports as fully
+    // covered: macOS tracks occlusion per window. Windows and X11 give JUCE no
+    // occlusion state, so there this only catches hidden and minimised windows.
+    if (!isShowing() || peer == nullptr || peer->isMinimised() || !peer->isShowing())
+        return false;
+
+    // An editor clipped away entirely by its parents, or in a window dragged
+    // off every display, is as good as covered
+    juce::RectangleList<int> visibleArea;
+    getVisibleArea(visibleArea, false);
+
+    if (visibleArea.isEmpty())
+        return false;
+
+    const auto screenBounds = getScreenBounds();
+
+    for (const auto& display : juce::Desktop::getInstance().getDisplays().displays)
+        if (display.totalArea.intersects(screenBounds))
+            return true;
+
+    return false;
+}
+
+void NewVerbTk1AudioProcessorEditor::refreshDisplay()
+{
+    // Nothing to draw while the window is hidden, minimised or covered, so stop
+    // the audio thread producing frames as well
+    const bool visible = isVisibleOnScreen();
+
+    audioProcessor.setSpectrumPublishingEnabled(visible);
+
+    if (visible)
+    {
+        // Both views draw from the same frame, and only when a new one has been published
+        auto& spectrum = audioProcessor.getSpectrumBuffer();
+
+        if (spectrum.fetchLatest())
+        {
+            spectrogramDisplay.update(spectrum.getReadFrame());
+            spectrumCurves.update(spectrum.getReadFrame());
+        }
+
+        loadMeter.update();
+    }
 }
\ No newline at end of file
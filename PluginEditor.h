@@ -8,8 +8,7 @@
  * NewVerbTk1 Audio Editor
  * Provides a graphical user interface for the spectral effect plugin.
  */
-class NewVerbTk1AudioProcessorEditor : public juce::AudioProcessorEditor,
-    private juce::Timer
+class NewVerbTk1AudioProcessorEditor : public juce::AudioProcessorEditor
 {
 public:
     NewVerbTk1AudioProcessorEditor(NewVerbTk1AudioProcessor&, juce::AudioProcessorValueTreeState&);
@@ -19,10 +18,13 @@ public:
     void paint(juce::Graphics&) override;
     void resized() override;
 
-    // Update the spectrogram display
-    void updateSpectrogramDisplay();
-
 private:
+    // Draws the gradient and panel chrome; paint() caches the result in backgroundImage
+    void drawBackground(juce::Graphics& g);
+
+    juce::Image backgroundImage;
+    float backgroundScale = 0.0f;
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     NewVerbTk1AudioProcessor& audioProcessor;
@@ -38,6 +40,11 @@ private:
     juce::Slider midBandSlider;
     juce::Slider highBandSlider;
     juce::ToggleButton freezeButton;
+    juce::ComboBox fftSizeBox;
+    juce::ComboBox overlapBox;
+    juce::ToggleButton lowLatencyButton;
+    juce::Slider convMixSlider;
+    juce::TextButton loadImpulseButton;
 
     // Labels for controls
     juce::Label titleLabel;
@@ -50,6 +57,9 @@ private:
     juce::Label midBandLabel;
     juce::Label highBandLabel;
     juce::Label freezeLabel;
+    juce::Label fftSizeLabel;
+    juce::Label overlapLabel;
+    juce::Label convMixLabel;
 
     // Attachment objects to connect slider/button values to parameters
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> wetDryAttachment;
@@ -61,28 +71,128 @@ private:
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> midBandAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> highBandAttachment;
     std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> freezeAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> fftSizeAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ComboBoxAttachment> overlapAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::ButtonAttachment> lowLatencyAttachment;
+    std::unique_ptr<juce::AudioProcessorValueTreeState::SliderAttachment> convMixAttachment;
+
+    // Impulse response file browser; kept alive while the asynchronous dialog is open
+    std::unique_ptr<juce::FileChooser> impulseChooser;
+    void chooseImpulseResponse();
+    void updateImpulseButtonText();
 
     // Spectrogram display
     class SpectrogramComponent : public juce::Component
     {
     public:
-        SpectrogramComponent(NewVerbTk1AudioProcessor& p);
+        SpectrogramComponent();
 
         void paint(juce::Graphics& g) override;
-        void update();
+        void resized() override;
+
+        // Scrolls in the output trace of a newly published analyser frame
+        void update(const SpectrumTripleBuffer::Frame& frame);
 
     private:
-        NewVerbTk1AudioProcessor& processor;
+        void drawOverlay(juce::Graphics& g);
+        void rebuildRowMap(int numBins);
+        int getColourIndex(float magnitude) const noexcept;
+
+        // Ring-buffer image: update() writes one column at writeColumn and
+        // paint() draws the two halves either side of it, newest on the right
         juce::Image spectrogramImage;
+        int writeColumn = 0;
+
+        // Grid, labels and border, rendered once per size and display scale
+        juce::Image overlayImage;
+        float overlayScale = 0.0f;
+
+        // Lookups built up front, so a column is only table reads and pixel writes
+        std::vector<int> rowToBin;                      // bottom row first
+        int rowMapNumBins = 0;
+        std::array<float, 255> levelThresholds {};      // magnitude at which colour step i + 1 starts
+        std::array<juce::PixelARGB, 256> colourTable {};
         juce::Colour gradientColours[6];
     };
 
     SpectrogramComponent spectrogramDisplay;
 
+    // The analyser's latest input, output and output peak-hold traces as curves
+    // over a logarithmic frequency axis
+    class SpectrumCurveComponent : public juce::Component
+    {
+    public:
+        explicit SpectrumCurveComponent(NewVerbTk1AudioProcessor& p);
+
+        void paint(juce::Graphics& g) override;
+        void resized() override;
+
+        void update(const SpectrumTripleBuffer::Frame& frame);
+        void setPeakTraceVisible(bool shouldBeVisible);
+
+    private:
+        static constexpr float minFrequency = 20.0f;
+        static constexpr float minDecibels = -96.0f;
+
+        void buildPath(juce::Path& path, const float* magnitudes, int numBins, float binWidth) const;
+        float getFrequencyAtX(float x) const noexcept;
+        float getXForFrequency(float frequency) const noexcept;
+        float getYForMagnitude(float magnitude) const noexcept;
+
+        NewVerbTk1AudioProcessor& processor;
+        float maxFrequency = 20000.0f;
+        juce::Path inputPath, outputPath, peakPath;
+        bool peakTraceVisible = true;
+    };
+
+    SpectrumCurveComponent spectrumCurves;
+
+    // Analyser settings; they are saved with the plugin state rather than as parameters
+    juce::ComboBox analyserResolutionBox;
+    juce::ComboBox analyserAveragingBox;
+    juce::ToggleButton analyserPeakHoldButton;
+    juce::Label analyserResolutionLabel;
+    juce::Label analyserAveragingLabel;
+
+    void setupAnalyserControls();
+    void applyAnalyserSettings();
+
+    // Processing load meter: average load over the last refresh, peak load and
+    // deadline overruns. Click to reset the statistics.
+    class LoadMeterComponent : public juce::Component
+    {
+    public:
+        explicit LoadMeterComponent(ProcessLoadMonitor& m);
+
+        void paint(juce::Graphics& g) override;
+        void mouseDown(const juce::MouseEvent& event) override;
+        void update();
+
+    private:
+        static constexpr double refreshIntervalMs = 100.0;
+
+        ProcessLoadMonitor& monitor;
+        ProcessLoadMonitor::Snapshot previousSnapshot;
+        double lastRefreshTime = 0.0;
+
+        float displayedLoad = 0.0f;
+        float displayedPeak = 0.0f;
+        juce::uint64 displayedOverruns = 0;
+    };
+
+    LoadMeterComponent loadMeter;
+
     // Generic method to setup a rotary slider
     void setupRotarySlider(juce::Slider& slider, juce::Label& label, const juce::String& labelText);
 
-    void timerCallback() override;
+    // Fills a combo box with the choices of a choice parameter
+    void setupChoiceBox(juce::ComboBox& box, juce::Label& label, const juce::String& labelText, const juce::String& parameterID);
+
+    // Called once per display refresh
+    void refreshDisplay();
+
+    // False while the editor's window is hidden, minimised, covered or off every display
+    bool isVisibleOnScreen() const;
 
     // Custom look and feel for sliders
     class CustomLookAndFeel : public juce::LookAndFeel_V4
@@ -92,9 +202,25 @@ private:
 
         void drawRotarySlider(juce::Graphics& g, int x, int y, int width, int height, float sliderPos,
             const float rotaryStartAngle, const float rotaryEndAngle, juce::Slider& slider) override;
+
+    private:
+        void drawKnob(juce::Graphics& g, int width, int height, float sliderPos,
+            float rotaryStartAngle, float rotaryEndAngle);
+
+        // One rendered knob per size, display scale (in percent), value bucket and angle range
+        using KnobCacheKey = std::tuple<int, int, int, int, int, int>;
+
+        static constexpr int knobCacheBuckets = 128;
+        static constexpr size_t maxCachedKnobs = 1024;
+
+        std::map<KnobCacheKey, juce::Image> knobCache;
     };
 
     CustomLookAndFeel customLookAndFeel;
 
+    // Drives refreshDisplay() from the display's vertical blank; declared last
+    // so it stops before anything it touches is destroyed
+    juce::VBlankAttachment vBlankAttachment { this, [this] { refreshDisplay(); } };
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NewVerbTk1AudioProcessorEditor)
 };
\ No newline at end of file
@@ -1,5 +1,40 @@
 ﻿#include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "RealtimeGuard.h"
+
+namespace
+{
+    // Arena bytes taken by the SliceBuffers of one sample type
+    template <typename SampleType>
+    size_t getSliceBufferBytes(int numChannels, int maxBlockSize, int dryHistorySize) noexcept
+    {
+        return SpectralWorkArena::bytesFor<SampleType>((size_t) maxBlockSize) * (size_t) (numChannels * 2 + 1)
+             + SpectralWorkArena::bytesFor<SampleType>((size_t) dryHistorySize) * (size_t) numChannels;
+    }
+
+    // Every parameter ID, in SpectralParams order
+    const char* const parameterIDs[] = { "wet_dry", "time", "density", "damping", "size", "low_band", "mid_band",
+                                         "high_band", "freeze", "fft_size", "overlap", "conv_mix", "low_latency" };
+
+    static_assert(std::size(parameterIDs) == NewVerbTk1AudioProcessor::TOTAL_NUM_PARAMS, "Add the ID of every parameter");
+
+    struct FactoryPreset
+    {
+        const char* name;
+        float wetDry, time, density, damping, size, lowBand, midBand, highBand, convMix;
+    };
+
+    // The first preset is the parameter defaults
+    const FactoryPreset factoryPresets[] =
+    {
+        { "Default",        0.5f,  2.0f, 0.5f, 0.5f,  0.5f, 1.0f, 1.0f, 1.0f, 0.5f },
+        { "Small Room",     0.3f,  0.6f, 0.7f, 0.4f,  0.2f, 0.8f, 1.0f, 0.9f, 0.3f },
+        { "Large Hall",     0.45f, 4.5f, 0.6f, 0.5f,  0.7f, 1.0f, 0.9f, 0.7f, 0.5f },
+        { "Dark Plate",     0.4f,  3.0f, 0.8f, 0.85f, 0.4f, 1.0f, 0.8f, 0.4f, 0.4f },
+        { "Bright Shimmer", 0.5f,  6.0f, 0.3f, 0.1f,  0.9f, 0.6f, 1.0f, 1.0f, 0.2f },
+        { "Ambient Wash",   0.8f, 10.0f, 0.9f, 0.6f,  1.0f, 1.0f, 1.0f, 0.8f, 0.6f }
+    };
+}
 
 //==============================================================================
 NewVerbTk1AudioProcessor::NewVerbTk1AudioProcessor()
@@ -7,8 +42,6 @@ NewVerbTk1AudioProcessor::NewVerbTk1AudioProcessor()
         .withInput("Input", juce::AudioChannelSet::stereo(), true)
         .withOutput("Output", juce::AudioChannelSet::stereo(), true)
     ),
-    forwardFFT(fftOrder),
-    inverseFFT(fftOrder),
     parameters(*this, nullptr, "PARAMETERS", createParameters())
 {
     // Get references to parameters
@@ -21,27 +54,36 @@ NewVerbTk1AudioProcessor::NewVerbTk1AudioProcessor()
     midBandParameter = parameters.getRawParameterValue("mid_band");
     highBandParameter = parameters.getRawParameterValue("high_band");
     freezeParameter = parameters.getRawParameterValue("freeze");
+    fftSizeParameter = parameters.getRawParameterValue("fft_size");
+    overlapParameter = parameters.getRawParameterValue("overlap");
+    convMixParameter = parameters.getRawParameterValue("conv_mix");
+    lowLatencyParameter = parameters.getRawParameterValue("low_latency");
 
-    // Initialize buffers
-    fftWorkingBuffer.resize(fftSize * 2, 0.0f); // Real + Imaginary
-    windowBuffer.resize(fftSize, 0.0f);
-    spectralMagnitudeBuffer.resize(fftSize / 2, 0.0f);
-
-    fftTimeDomainBuffer.resize(fftSize, std::complex<float>(0.0f, 0.0f));
-    fftFrequencyDomainBuffer.resize(fftSize, std::complex<float>(0.0f, 0.0f));
-    fftConvolutionBuffer.resize(fftSize, std::complex<float>(0.0f, 0.0f));
+    // Resolution changes rebuild the STFT engine on the message thread
+    parameters.addParameterListener("fft_size", this);
+    parameters.addParameterListener("overlap", this);
+    parameters.addParameterListener("low_latency", this);
 
-    // Initialize Hann window
-    for (int i = 0; i < fftSize; ++i)
-        windowBuffer[i] = 0.5f - 0.5f * std::cos(2.0f * juce::MathConstants<float>::pi * i / (fftSize - 1));
+    createPresets();
 
-    // Start timer for spectrogram updates
-    startTimerHz(30); // Update 30 times per second
+    // The audio-thread working set is allocated in prepareToPlay
+    setLatencySamples(1 << defaultFFTOrder);
+    updateTailLength();
 }
 
 NewVerbTk1AudioProcessor::~NewVerbTk1AudioProcessor()
 {
-    stopTimer();
+    cancelPendingUpdate();
+
+    parameters.removeParameterListener("fft_size", this);
+    parameters.removeParameterListener("overlap", this);
+    parameters.removeParameterListener("low_latency", this);
+
+    delete pendingEngine.exchange(nullptr);
+    deleteRetiredEngines();
+
+    delete pendingConvolver.exchange(nullptr);
+    delete retiredConvolver.exchange(nullptr);
 }
 
 //==============================================================================
@@ -59,10 +101,28 @@ juce::AudioProcessorValueTreeState::ParameterLayout NewVerbTk1AudioProcessor::cr
     params.push_back(std::make_unique<juce::AudioParameterFloat>("mid_band", "Mid Band", 0.0f, 1.0f, 1.0f));
     params.push_back(std::make_unique<juce::AudioParameterFloat>("high_band", "High Band", 0.0f, 1.0f, 1.0f));
     params.push_back(std::make_unique<juce::AudioParameterBool>("freeze", "Freeze", false));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("fft_size", "FFT Size",
+        juce::StringArray { "512", "1024", "2048", "4096", "8192", "16384" }, defaultFFTOrder - StftEngine::minFFTOrder));
+    params.push_back(std::make_unique<juce::AudioParameterChoice>("overlap", "Overlap",
+        juce::StringArray { "2x", "4x", "8x" }, 1));
+    params.push_back(std::make_unique<juce::AudioParameterFloat>("conv_mix", "Convolution Mix", 0.0f, 1.0f, 0.5f));
+    params.push_back(std::make_unique<juce::AudioParameterBool>("low_latency", "Hybrid FFT", false));
 
     return { params.begin(), params.end() };
 }
 
+void NewVerbTk1AudioProcessor::createPresets()
+{
+    for (const auto& preset : factoryPresets)
+    {
+        presets.push_back({ preset.name,
+                            { { "wet_dry", preset.wetDry }, { "time", preset.time }, { "density", preset.density },
+                              { "damping", preset.damping }, { "size", preset.size }, { "low_band", preset.lowBand },
+                              { "mid_band", preset.midBand }, { "high_band", preset.highBand }, { "freeze", 0.0f },
+                              { "conv_mix", preset.convMix } } });
+    }
+}
+
 //==============================================================================
 const juce::String NewVerbTk1AudioProcessor::getName() const
 {
@@ -86,62 +146,173 @@ bool NewVerbTk1AudioProcessor::isMidiEffect() const
 
 double NewVerbTk1AudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return tailLengthSeconds.load();
 }
 
 int NewVerbTk1AudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-    // so this should be at least 1, even if you're not really implementing programs.
+    return (int) presets.size();
 }
 
 int NewVerbTk1AudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void NewVerbTk1AudioProcessor::setCurrentProgram(int index)
 {
-    juce::ignoreUnused(index);
+    if (!juce::isPositiveAndBelow(index, (int) presets.size()))
+        return;
+
+    currentProgram = index;
+    applyParameterValues(presets[(size_t) index].parameterValues, false);
+    updateHostDisplay(ChangeDetails().withProgramChanged(true));
 }
 
 const juce::String NewVerbTk1AudioProcessor::getProgramName(int index)
 {
-    juce::ignoreUnused(index);
-    return {};
+    return juce::isPositiveAndBelow(index, (int) presets.size()) ? presets[(size_t) index].name : juce::String();
 }
 
 void NewVerbTk1AudioProcessor::changeProgramName(int index, const juce::String& newName)
 {
+    // The factory presets keep their names
     juce::ignoreUnused(index, newName);
 }
 
 //==============================================================================
 void NewVerbTk1AudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
 {
-    // Initialize processing buffers
-    fftInputBuffer.setSize(2, fftSize * 2); // stereo buffer with enough room for overlapping
-    fftInputBuffer.clear();
+    const int numChannels = juce::jmax(1, getTotalNumInputChannels());
+    maxBlockSize = juce::jmax(1, samplesPerBlock);
+    preparedNumChannels = numChannels;
+    preparedSampleRate = sampleRate;
+
+    // Start from a clean engine at the requested resolution, dropping any swap in flight
+    fadingEngine.reset();
+    delete pendingEngine.exchange(nullptr);
+    deleteRetiredEngines();
+
+    // The host picks the precision before calling prepareToPlay
+    preparedFFTOrder = getRequestedFFTOrder();
+    preparedOverlap = getRequestedOverlap();
+    preparedDoublePrecision = isUsingDoublePrecision();
+    preparedLowLatency = isLowLatencyRequested();
+    stftEngine = StftEngine::create(preparedFFTOrder, preparedOverlap, hopTracer, preparedDoublePrecision, preparedLowLatency);
+    stftEngine->prepare(numChannels);
+    switchedEngineLatency.store(-1);
+    setLatencySamples(stftEngine->getLatencyInSamples());
+
+    engineWarmupRemaining = 0;
+    engineCrossfadeRemaining = 0;
+
+    // A state restored before playback applies at once
+    appliedPresetGeneration = presetGeneration.load();
+    presetCrossfadeRemaining = 0;
+    loadParameterValues(0);
+
+    // Restarting the modulation here makes every render from the start identical
+    densityModulator.prepare((1 << StftEngine::maxFFTOrder) / 2 + 1, sampleRate, densityModulationSeed);
+
+    // Rebuild the convolver for this sample rate and channel count
+    delete pendingConvolver.exchange(nullptr);
+    delete retiredConvolver.exchange(nullptr);
+    convolverUnloadRequested.store(false);
+    convolver.reset();
+
+    if (impulseResponseFile != juce::File())
+    {
+        convolver = PartitionedConvolver::createFromFile(impulseResponseFile, sampleRate, numChannels);
+
+        // A file that has gone or can't be read is forgotten rather than saved with the state
+        if (convolver == nullptr)
+            impulseResponseFile = juce::File();
+    }
+
+    preparedImpulseLength = convolver != nullptr ? convolver->getImpulseLength() : 0;
+    updateTailLength();
+
+    silentInputSamples = 0;
+    wetPathAsleep = false;
+
+    // The dry history must cover the largest possible engine latency plus a block
+    const int dryHistorySize = juce::nextPowerOfTwo((1 << StftEngine::maxFFTOrder) + maxBlockSize);
+    dryHistoryMask = dryHistorySize - 1;
+    dryHistoryPosition = 0;
+
+    // Size the whole audio-thread working set in one go
+    size_t gainCurveBytes = 0;
+
+    for (int order = minGainCurveOrder; order <= StftEngine::maxFFTOrder; ++order)
+        gainCurveBytes += SpectralWorkArena::bytesFor<float>((1 << order) / 2 + 1);
+
+    const size_t sliceBufferBytes = preparedDoublePrecision ? getSliceBufferBytes<double>(numChannels, maxBlockSize, dryHistorySize)
+                                                            : getSliceBufferBytes<float>(numChannels, maxBlockSize, dryHistorySize);
+
+    workArena.allocate(sliceBufferBytes
+                       + SpectralWorkArena::bytesFor<float>(maxBlockSize) * numChannels
+                       + gainCurveBytes);
+
+    floatBuffers.release();
+    doubleBuffers.release();
+
+    if (preparedDoublePrecision)
+        allocateSliceBuffers<double>(numChannels, dryHistorySize);
+    else
+        allocateSliceBuffers<float>(numChannels, dryHistorySize);
+
+    std::vector<float*> convolutionChannels(numChannels);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        convolutionChannels[channel] = workArena.take<float>(maxBlockSize);
+
+    convolutionBuffer.setDataToReferTo(convolutionChannels.data(), numChannels, maxBlockSize);
+
+    // One gain curve per FFT size, so an engine swap never forces a rebuild per hop
+    for (int order = minGainCurveOrder; order <= StftEngine::maxFFTOrder; ++order)
+    {
+        auto& curve = gainCurves[(size_t) (order - minGainCurveOrder)];
+        curve = GainCurve();
+        curve.numBins = (1 << order) / 2 + 1;
+        curve.gains = workArena.take<float>((size_t) curve.numBins);
+    }
 
-    fftOutputBuffer.setSize(2, fftSize * 2);
-    fftOutputBuffer.clear();
+    updateWorkerPool();
 
-    fifoIndex = 0;
-    nextFFTBlockReady = false;
+    spectrumAnalyser.prepare(sampleRate);
+    loadMonitor.prepare(sampleRate);
+
+    // Resolve the kernel dispatch (a CPU feature query) before the audio thread needs it
+    juce::ignoreUnused(SpectralKernels::getInstructionSet());
 }
 
 void NewVerbTk1AudioProcessor::releaseResources()
 {
     // Free resources when not playing
-    fftInputBuffer.setSize(0, 0);
-    fftOutputBuffer.setSize(0, 0);
+    floatBuffers.release();
+    doubleBuffers.release();
+    convolutionBuffer.setSize(0, 0);
+    gainCurves = {};
+    workArena.release();
+
+    stftEngine.reset();
+    fadingEngine.reset();
+    delete pendingEngine.exchange(nullptr);
+    deleteRetiredEngines();
+
+    convolver.reset();
+    delete pendingConvolver.exchange(nullptr);
+    delete retiredConvolver.exchange(nullptr);
+    convolverUnloadRequested.store(false);
+
+    workerPool.reset();
 }
 
 bool NewVerbTk1AudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
 {
-    // We support mono or stereo for both input and output
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-        && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // Any layout works, from mono to surround and ambisonic beds, since every
+    // channel is processed the same way
+    if (layouts.getMainOutputChannelSet().isDisabled())
         return false;
 
     // Input and output must be the same
@@ -151,10 +322,61 @@ bool NewVerbTk1AudioProcessor::isBusesLayoutSupported(const BusesLayout& layouts
     return true;
 }
 
+template <typename SampleType>
+NewVerbTk1AudioProcessor::SliceBuffers<SampleType>& NewVerbTk1AudioProcessor::getSliceBuffers() noexcept
+{
+    if constexpr (std::is_same_v<SampleType, double>)
+        return doubleBuffers;
+    else
+        return floatBuffers;
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::allocateSliceBuffers(int numChannels, int dryHistorySize)
+{
+    auto& buffers = getSliceBuffers<SampleType>();
+    std::vector<SampleType*> dryChannels(numChannels), fadingChannels(numChannels), historyChannels(numChannels);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        dryChannels[channel] = workArena.take<SampleType>(maxBlockSize);
+        fadingChannels[channel] = workArena.take<SampleType>(maxBlockSize);
+        historyChannels[channel] = workArena.take<SampleType>(dryHistorySize);
+    }
+
+    buffers.dry.setDataToReferTo(dryChannels.data(), numChannels, maxBlockSize);
+    buffers.fadingEngine.setDataToReferTo(fadingChannels.data(), numChannels, maxBlockSize);
+    buffers.dryHistory.setDataToReferTo(historyChannels.data(), numChannels, dryHistorySize);
+    buffers.engineCrossfadeGains = workArena.take<SampleType>(maxBlockSize);
+}
+
+bool NewVerbTk1AudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
 void NewVerbTk1AudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    juce::ScopedNoDenormals noDenormals;
     juce::ignoreUnused(midiMessages);
+    processBlockWithSampleType(buffer);
+}
+
+void NewVerbTk1AudioProcessor::processBlock(juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    processBlockWithSampleType(buffer);
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::processBlockWithSampleType(juce::AudioBuffer<SampleType>& buffer) noexcept
+{
+    juce::ScopedNoDenormals noDenormals;
+    ScopedRealtimeAllocationGuard allocationGuard;
+    HopTracer::Scope blockTrace(hopTracer, HopTracer::Stage::block);
+
+    // Hosts only change precision around prepareToPlay, which allocates for it
+    auto& buffers = getSliceBuffers<SampleType>();
+    jassert(buffers.dryHistory.getNumChannels() > 0);
 
     auto totalNumInputChannels = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -163,145 +385,499 @@ void NewVerbTk1AudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, ju
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear(i, 0, buffer.getNumSamples());
 
+    const auto blockStartTicks = loadMonitor.beginBlock(buffer, totalNumInputChannels);
+
     // Get current parameter values
-    wetDry = wetDryParameter->load();
-    time = timeParameter->load();
-    density = densityParameter->load();
-    damping = dampingParameter->load();
-    size = sizeParameter->load();
-    lowBand = lowBandParameter->load();
-    midBand = midBandParameter->load();
-    highBand = highBandParameter->load();
+    loadParameterValues(buffer.getNumSamples());
+
+    // Pick up an engine rebuilt for a new FFT size or overlap
+    takePendingEngine();
+    jassert(stftEngine != nullptr);
+
+    stftEngine->setPairedTransforms(pairedTransforms.load());
+
+    if (fadingEngine != nullptr)
+        fadingEngine->setPairedTransforms(pairedTransforms.load());
+
+    // Pick up a newly loaded impulse response
+    takePendingConvolver();
+
+    // Refresh the gain curves the running engines use, before any hop reads them
+    updateGainCurves(*stftEngine);
+
+    if (fadingEngine != nullptr)
+        updateGainCurves(*fadingEngine);
+
+    // The analyser is only fed while an editor is showing its frames
+    const bool feedAnalyser = spectrumAnalyser.isEnabled();
+
+    // Hosts may exceed the block size announced in prepareToPlay, so work through
+    // the buffer in slices that fit the preallocated buffers
+    for (int sliceStart = 0; sliceStart < buffer.getNumSamples(); sliceStart += maxBlockSize)
+    {
+        const int sliceLength = juce::jmin(maxBlockSize, buffer.getNumSamples() - sliceStart);
+
+        // Keep the original signal for wet/dry mixing, delayed to line up with the wet path
+        pushDryHistory(buffer, sliceStart, sliceLength);
+
+        if (updateWetPathSleep(buffer, sliceStart, sliceLength))
+        {
+            // The wet path would only produce silence: keep the hop clock running instead
+            stftEngine->skipSilence(sliceLength);
+
+            for (int channel = 0; channel < juce::jmin(totalNumInputChannels, preparedNumChannels); ++channel)
+                buffer.clear(channel, sliceStart, sliceLength);
+
+            readDelayedDry<SampleType>(sliceLength);
+        }
+        else
+        {
+            processWetSlice(buffer, sliceStart, sliceLength);
+            readDelayedDry<SampleType>(sliceLength);
+            processConvolutionSlice(buffer, sliceStart, sliceLength);
+            advanceEngineCrossfade(sliceLength);
+        }
+
+        // Apply wet/dry mix, ramped across the block while a preset glides
+        const float wetStart = getRampedGain(wetDry, wetDryEnd, sliceStart, buffer.getNumSamples());
+        const float wetEnd = getRampedGain(wetDry, wetDryEnd, sliceStart + sliceLength, buffer.getNumSamples());
+
+        for (int channel = 0; channel < totalNumInputChannels; ++channel)
+        {
+            const SampleType* dryData = buffers.dry.getReadPointer(channel);
+
+            buffer.applyGainRamp(channel, sliceStart, sliceLength, (SampleType) wetStart, (SampleType) wetEnd);
+            buffer.addFromWithRamp(channel, sliceStart, dryData, sliceLength, (SampleType) (1.0f - wetStart), (SampleType) (1.0f - wetEnd));
+        }
+
+        // The delayed dry signal is the input as it lines up with this output
+        if (feedAnalyser)
+        {
+            HopTracer::Scope publishTrace(hopTracer, HopTracer::Stage::guiPublish);
+            spectrumAnalyser.pushSamples(buffers.dry, 0, buffer, sliceStart, sliceLength);
+        }
+    }
+
+    loadMonitor.endBlock(blockStartTicks, buffer, totalNumOutputChannels);
+}
+
+void NewVerbTk1AudioProcessor::loadParameterValues(int numSamples) noexcept
+{
+    float* const values[] = { &wetDry, &time, &density, &damping, &size, &lowBand, &midBand, &highBand, &convMix };
+    std::atomic<float>* const sources[] = { wetDryParameter, timeParameter, densityParameter, dampingParameter, sizeParameter,
+                                            lowBandParameter, midBandParameter, highBandParameter, convMixParameter };
+
+    static_assert(std::size(values) == numGlidingParameters && std::size(sources) == numGlidingParameters, "");
+
+    // Read the parameters before the generation: it is bumped before any of a
+    // preset's values are set, so seeing one of them means seeing the new generation
+    std::array<float, numGlidingParameters> targets;
+
+    for (size_t i = 0; i < targets.size(); ++i)
+        targets[i] = sources[i]->load();
+
     freeze = freezeParameter->load() > 0.5f;
 
-    // Keep the original signal for wet/dry mixing
-    juce::AudioBuffer<float> dryBuffer;
-    dryBuffer.makeCopyOf(buffer);
+    const auto generation = presetGeneration.load();
+
+    // The mix gains carry on from where the last block's ramp ended
+    wetDry = wetDryEnd;
+    convMix = convMixEnd;
+
+    if (generation != appliedPresetGeneration)
+    {
+        appliedPresetGeneration = generation;
+        presetCrossfadeRemaining = presetCrossfadeLength;
+
+        for (size_t i = 0; i < presetCrossfadeStart.size(); ++i)
+            presetCrossfadeStart[i] = *values[i];
+    }
+
+    if (presetCrossfadeRemaining == 0)
+    {
+        for (size_t i = 0; i < targets.size(); ++i)
+            *values[i] = targets[i];
+
+        wetDryEnd = wetDry;
+        convMixEnd = convMix;
+        return;
+    }
+
+    // The glide's progress at the start and at the end of this block
+    const float startProgress = 1.0f - presetCrossfadeRemaining / (float) presetCrossfadeLength;
+    presetCrossfadeRemaining = juce::jmax(0, presetCrossfadeRemaining - numSamples);
+    const float endProgress = 1.0f - presetCrossfadeRemaining / (float) presetCrossfadeLength;
+
+    auto glideValue = [&](size_t i, float progress) { return presetCrossfadeStart[i] + (targets[i] - presetCrossfadeStart[i]) * progress; };
+
+    // The spectral parameters step once per block, and the gain curves follow
+    // through updateGainCurves(). The mix gains ramp on to the block end.
+    for (size_t i = 0; i < targets.size(); ++i)
+        *values[i] = glideValue(i, startProgress);
+
+    // wetDry comes first in values and convMix last
+    wetDryEnd = glideValue(0, endProgress);
+    convMixEnd = glideValue(targets.size() - 1, endProgress);
+}
+
+void NewVerbTk1AudioProcessor::takePendingEngine() noexcept
+{
+    // Finish one swap before starting the next
+    if (fadingEngine != nullptr)
+        return;
+
+    if (auto* engine = pendingEngine.exchange(nullptr))
+    {
+        fadingEngine = std::move(stftEngine);
+        stftEngine.reset(engine);
+
+        // Let the new engine fill its frame before fading it in, so the wet
+        // signal never dips while the new rings are still empty.
+        engineWarmupRemaining = stftEngine->getFFTSize();
+        engineCrossfadeRemaining = engineCrossfadeLength;
+
+        // The host compensates for the new latency from here on
+        switchedEngineLatency.store(stftEngine->getLatencyInSamples());
+        triggerAsyncUpdate();
+    }
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::processWetSlice(juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept
+{
+    const int numChannels = juce::jmin(buffer.getNumChannels(), preparedNumChannels);
+    auto* pool = parallelChannelProcessing.load() ? workerPool.get() : nullptr;
+    auto& fadingEngineBuffer = getSliceBuffers<SampleType>().fadingEngine;
+    auto* engineCrossfadeGains = getSliceBuffers<SampleType>().engineCrossfadeGains;
+
+    if (fadingEngine != nullptr)
+        for (int channel = 0; channel < numChannels; ++channel)
+            fadingEngineBuffer.copyFrom(channel, 0, buffer, channel, sliceStart, sliceLength);
+
+    // Run the STFT over the slice; spectra come back through processSpectra()
+    stftEngine->process(buffer, sliceStart, sliceLength, *this, pool);
+
+    if (fadingEngine == nullptr)
+        return;
+
+    fadingEngine->process(fadingEngineBuffer, 0, sliceLength, *this, pool);
+
+    // Gain of the new engine for each sample of the slice: zero while it warms up, then a linear ramp
+    int warmup = engineWarmupRemaining;
+    int fadePosition = engineCrossfadeLength - engineCrossfadeRemaining;
+
+    for (int i = 0; i < sliceLength; ++i)
+    {
+        if (warmup > 0)
+            --warmup;
+        else
+            fadePosition = juce::jmin(fadePosition + 1, engineCrossfadeLength);
+
+        engineCrossfadeGains[i] = fadePosition / (SampleType) engineCrossfadeLength;
+    }
+
+    // wet = old + (new - old) * gain
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        SampleType* wet = buffer.getWritePointer(channel, sliceStart);
+        const SampleType* old = fadingEngineBuffer.getReadPointer(channel);
+
+        juce::FloatVectorOperations::subtract(wet, old, sliceLength);
+        juce::FloatVectorOperations::multiply(wet, engineCrossfadeGains, sliceLength);
+        juce::FloatVectorOperations::add(wet, old, sliceLength);
+    }
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::pushDryHistory(const juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept
+{
+    auto& dryHistory = getSliceBuffers<SampleType>().dryHistory;
+    const int numChannels = juce::jmin(buffer.getNumChannels(), preparedNumChannels);
+    const int firstPart = juce::jmin(sliceLength, dryHistory.getNumSamples() - dryHistoryPosition);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        dryHistory.copyFrom(channel, dryHistoryPosition, buffer, channel, sliceStart, firstPart);
+        dryHistory.copyFrom(channel, 0, buffer, channel, sliceStart + firstPart, sliceLength - firstPart);
+    }
+
+    dryHistoryPosition = (dryHistoryPosition + sliceLength) & dryHistoryMask;
+}
+
+template <typename SampleType, typename DestType>
+void NewVerbTk1AudioProcessor::readDryHistory(juce::AudioBuffer<DestType>& dest, int numSamples, int delay) noexcept
+{
+    const auto& dryHistory = getSliceBuffers<SampleType>().dryHistory;
+
+    // The slice just pushed ends at dryHistoryPosition
+    const int start = (dryHistoryPosition - numSamples - delay) & dryHistoryMask;
+    const int firstPart = juce::jmin(numSamples, dryHistory.getNumSamples() - start);
+
+    for (int channel = 0; channel < juce::jmin(dest.getNumChannels(), dryHistory.getNumChannels()); ++channel)
+    {
+        DestType* destData = dest.getWritePointer(channel);
+        const SampleType* historyData = dryHistory.getReadPointer(channel);
+
+        SampleConversion::copy(destData, historyData + start, firstPart);
+        SampleConversion::copy(destData + firstPart, historyData, numSamples - firstPart);
+    }
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::readDelayedDry(int sliceLength) noexcept
+{
+    auto& buffers = getSliceBuffers<SampleType>();
+    readDryHistory<SampleType>(buffers.dry, sliceLength, stftEngine->getLatencyInSamples());
+
+    if (fadingEngine == nullptr)
+        return;
+
+    // Move the dry delay along with the wet crossfade, reusing the fading engine's buffer
+    readDryHistory<SampleType>(buffers.fadingEngine, sliceLength, fadingEngine->getLatencyInSamples());
+
+    for (int channel = 0; channel < buffers.dry.getNumChannels(); ++channel)
+    {
+        SampleType* dry = buffers.dry.getWritePointer(channel);
+        const SampleType* old = buffers.fadingEngine.getReadPointer(channel);
+
+        juce::FloatVectorOperations::subtract(dry, old, sliceLength);
+        juce::FloatVectorOperations::multiply(dry, buffers.engineCrossfadeGains, sliceLength);
+        juce::FloatVectorOperations::add(dry, old, sliceLength);
+    }
+}
+
+void NewVerbTk1AudioProcessor::advanceEngineCrossfade(int sliceLength) noexcept
+{
+    if (fadingEngine == nullptr)
+        return;
+
+    const int warmupStep = juce::jmin(engineWarmupRemaining, sliceLength);
+    engineWarmupRemaining -= warmupStep;
+    engineCrossfadeRemaining = juce::jmax(0, engineCrossfadeRemaining - (sliceLength - warmupStep));
 
-    // Process each stereo channel
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+    if (engineWarmupRemaining > 0 || engineCrossfadeRemaining > 0)
+        return;
+
+    // Hand the old engine back to the message thread. If every slot is still
+    // occupied we simply hold on to it and try again next block.
+    for (auto& slot : retiredEngines)
     {
-        const float* inputData = buffer.getReadPointer(channel);
-        float* outputData = buffer.getWritePointer(channel);
+        StftEngine* expected = nullptr;
 
-        // Add new samples to FFT input buffer
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
+        if (slot.compare_exchange_strong(expected, fadingEngine.get()))
         {
-            // Add the sample to the FFT input buffer with overlap
-            fftInputBuffer.setSample(channel, fifoIndex, inputData[sample]);
-
-            // Process when we have enough samples
-            if (fifoIndex >= hopSize)
-            {
-                // We have enough samples to process the next FFT block
-                nextFFTBlockReady = true;
-            }
-
-            // Move to the next sample in our FIFO
-            fifoIndex = (fifoIndex + 1) % fftSize;
-
-            // If we have processed data available, output it
-            if (fifoIndex % hopSize == 0)
-            {
-                // Perform the spectral processing if needed
-                if (nextFFTBlockReady)
-                {
-                    // Copy data from the input buffer for processing
-                    for (int i = 0; i < fftSize; ++i)
-                    {
-                        int circularIndex = (fifoIndex + i) % fftSize;
-                        float windowedSample = fftInputBuffer.getSample(channel, circularIndex) * windowBuffer[i];
-                        fftTimeDomainBuffer[i] = std::complex<float>(windowedSample, 0.0f);
-                    }
-
-                    // Forward FFT - convert to using JUCE's FFT interface properly
-                    std::vector<float> fftInOut(fftSize * 2, 0.0f);
-
-                    // Copy real data to the real part of the FFT input
-                    for (int i = 0; i < fftSize; ++i)
-                    {
-                        fftInOut[i * 2] = fftTimeDomainBuffer[i].real();
-                        fftInOut[i * 2 + 1] = 0.0f; // Imaginary part is zero
-                    }
-
-                    // Perform forward FFT (in-place)
-                    forwardFFT.performRealOnlyForwardTransform(fftInOut.data(), false);
-
-                    // Convert back to our complex format for processing
-                    for (int i = 0; i < fftSize; ++i)
-                    {
-                        fftFrequencyDomainBuffer[i] = std::complex<float>(fftInOut[i * 2], fftInOut[i * 2 + 1]);
-                    }
-
-                    // Apply spectral processing
-                    applySpectralProcessing(fftFrequencyDomainBuffer);
-
-                    // Inverse FFT - convert to using JUCE's FFT interface properly
-                    std::vector<float> ifftInOut(fftSize * 2, 0.0f);
-
-                    // Copy complex data to the FFT input
-                    for (int i = 0; i < fftSize; ++i)
-                    {
-                        ifftInOut[i * 2] = fftFrequencyDomainBuffer[i].real();
-                        ifftInOut[i * 2 + 1] = fftFrequencyDomainBuffer[i].imag();
-                    }
-
-                    // Perform inverse FFT (in-place)
-                    inverseFFT.performRealOnlyInverseTransform(ifftInOut.data());
-
-                    // Convert back to our complex format
-                    for (int i = 0; i < fftSize; ++i)
-                    {
-                        fftTimeDomainBuffer[i] = std::complex<float>(ifftInOut[i * 2], 0.0f);
-                    }
-
-                    // Store processed data in output buffer for overlap-add
-                    for (int i = 0; i < fftSize; ++i)
-                    {
-                        int outputIndex = (fifoIndex + i) % fftSize;
-                        float processedSample = fftTimeDomainBuffer[i].real() * windowBuffer[i] / (fftSize / 2.0f);
-
-                        // Overlap-add
-                        float currentSample = fftOutputBuffer.getSample(channel, outputIndex);
-                        fftOutputBuffer.setSample(channel, outputIndex, currentSample + processedSample);
-                    }
-
-                    nextFFTBlockReady = false;
-                }
-            }
-
-            // Copy from the output buffer to the actual output
-            outputData[sample] = fftOutputBuffer.getSample(channel, fifoIndex);
-
-            // Clear the sample we just read
-            fftOutputBuffer.setSample(channel, fifoIndex, 0.0f);
+            fadingEngine.release();
+            return;
         }
     }
+}
+
+template <typename SampleType>
+bool NewVerbTk1AudioProcessor::updateWetPathSleep(const juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept
+{
+    const int numChannels = juce::jmin(buffer.getNumChannels(), preparedNumChannels);
+    bool sliceIsSilent = true;
+
+    for (int channel = 0; channel < numChannels && sliceIsSilent; ++channel)
+        sliceIsSilent = buffer.getMagnitude(channel, sliceStart, sliceLength) < (SampleType) silenceThreshold;
+
+    silentInputSamples = sliceIsSilent ? silentInputSamples + sliceLength : 0;
+
+    // Sleep only once the whole wet tail lies before this slice, and never
+    // during an engine crossfade. Any input above the threshold wakes the wet
+    // path for the whole slice it arrives in; the engine's cleared rings and
+    // running hop clock make that identical to having processed the silence.
+    const int tailSamples = getWetTailSamples(stftEngine->getFFTSize(), stftEngine->getLatencyInSamples(),
+                                              convolver != nullptr ? convolver->getImpulseLength() : 0);
+    const bool shouldSleep = sliceIsSilent && fadingEngine == nullptr
+                          && silentInputSamples - sliceLength >= tailSamples;
+
+    // The convolver only holds the residue of the silence, so start it afresh
+    if (shouldSleep && !wetPathAsleep && convolver != nullptr)
+        convolver->reset();
+
+    wetPathAsleep = shouldSleep;
+    return shouldSleep;
+}
 
-    // Apply wet/dry mix
-    for (int channel = 0; channel < totalNumInputChannels; ++channel)
+int NewVerbTk1AudioProcessor::getWetTailSamples(int fftSize, int engineLatency, int impulseLength) noexcept
+{
+    // Two frames for the STFT (see StftEngine::getTailLengthInSamples()). The
+    // convolver hears the input after the dry delay in front of it, its own
+    // partition latency and up to one more partition of buffering, and then
+    // rings for the length of the impulse response.
+    const int engineTail = 2 * fftSize;
+
+    if (impulseLength <= 0)
+        return engineTail;
+
+    const int convolverLatency = PartitionedConvolver::partitionSize;
+    const int convolverTail = juce::jmax(engineLatency, convolverLatency) + convolverLatency + impulseLength;
+
+    return juce::jmax(engineTail, convolverTail);
+}
+
+void NewVerbTk1AudioProcessor::updateTailLength()
+{
+    // The tail follows the requested engine, which the message thread builds next
+    // and whose latency is a frame in either mode
+    const int fftSize = 1 << getRequestedFFTOrder();
+    const double sampleRate = preparedSampleRate > 0.0 ? preparedSampleRate : 44100.0;
+
+    tailLengthSeconds.store(getWetTailSamples(fftSize, fftSize, preparedImpulseLength) / sampleRate);
+}
+
+void NewVerbTk1AudioProcessor::takePendingConvolver() noexcept
+{
+    // Wait until the message thread has collected the previous convolver
+    if (retiredConvolver.load() != nullptr)
+        return;
+
+    if (auto* newConvolver = pendingConvolver.exchange(nullptr))
     {
-        float* channelData = buffer.getWritePointer(channel);
-        const float* dryData = dryBuffer.getReadPointer(channel);
+        retiredConvolver.store(convolver.release());
+        convolver.reset(newConvolver);
+    }
+    else if (convolverUnloadRequested.exchange(false))
+    {
+        retiredConvolver.store(convolver.release());
+    }
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::processConvolutionSlice(juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept
+{
+    if (convolver == nullptr)
+        return;
+
+    // Feed the convolver dry input delayed so that, after its own partition
+    // latency, its output lines up with the STFT's
+    const int delay = juce::jmax(0, stftEngine->getLatencyInSamples() - convolver->getLatencyInSamples());
+    readDryHistory<SampleType>(convolutionBuffer, sliceLength, delay);
 
-        for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
+    // Keep running at zero mix so the tail is already built when the mix is raised
+    convolver->process(convolutionBuffer, 0, sliceLength);
+
+    // Ramped across the block while a preset glides
+    const auto mixStart = (SampleType) getRampedGain(convMix, convMixEnd, sliceStart, buffer.getNumSamples());
+    const auto mixEnd = (SampleType) getRampedGain(convMix, convMixEnd, sliceStart + sliceLength, buffer.getNumSamples());
+
+    for (int channel = 0; channel < juce::jmin(buffer.getNumChannels(), convolutionBuffer.getNumChannels()); ++channel)
+        SampleConversion::addWithMultiplyRamp(buffer.getWritePointer(channel, sliceStart), convolutionBuffer.getReadPointer(channel),
+                                              mixStart, mixEnd, sliceLength);
+}
+
+void NewVerbTk1AudioProcessor::processSpectra(float* real, float* imag, int numBins, int numChannels,
+                                              int firstChannel, juce::int64 streamPosition)
+{
+    juce::ignoreUnused(firstChannel);
+
+    // May run concurrently for several channel groups: the kernels only read the
+    // parameter snapshot taken at the start of the block
+    applySpectralProcessing(real, imag, numBins, numChannels, streamPosition);
+    loadMonitor.addHops(numChannels);
+}
+
+void NewVerbTk1AudioProcessor::processSpectra(double* real, double* imag, int numBins, int numChannels,
+                                              int firstChannel, juce::int64 streamPosition)
+{
+    juce::ignoreUnused(firstChannel);
+
+    applySpectralProcessing(real, imag, numBins, numChannels, streamPosition);
+    loadMonitor.addHops(numChannels);
+}
+
+template <typename SampleType>
+void NewVerbTk1AudioProcessor::applySpectralProcessing(SampleType* real, SampleType* imag, int numBins, int numChannels,
+                                                       juce::int64 streamPosition) noexcept
+{
+    // Give the kernels a compile-time channel count, so the loop over the
+    // interleaved channels of each bin is unrolled into the SIMD lanes
+    static_assert(StftEngine::maxGroupChannels == 8, "Add a case for every group width");
+
+    switch (numChannels)
+    {
+        case 1:  applySpectralProcessing<1>(real, imag, numBins, streamPosition); break;
+        case 2:  applySpectralProcessing<2>(real, imag, numBins, streamPosition); break;
+        case 3:  applySpectralProcessing<3>(real, imag, numBins, streamPosition); break;
+        case 4:  applySpectralProcessing<4>(real, imag, numBins, streamPosition); break;
+        case 5:  applySpectralProcessing<5>(real, imag, numBins, streamPosition); break;
+        case 6:  applySpectralProcessing<6>(real, imag, numBins, streamPosition); break;
+        case 7:  applySpectralProcessing<7>(real, imag, numBins, streamPosition); break;
+        case 8:  applySpectralProcessing<8>(real, imag, numBins, streamPosition); break;
+        default: jassertfalse; break;
+    }
+}
+
+template <int NumChannels, typename SampleType>
+void NewVerbTk1AudioProcessor::applySpectralProcessing(SampleType* real, SampleType* imag, int numBins,
+                                                       juce::int64 streamPosition) noexcept
+{
+    // Freeze leaves the spectrum exactly as it is
+    if (freeze)
+        return;
+
+    // Spectral processing based on our parameters. DC and Nyquist are left untouched.
+    const int nyquistBin = numBins - 1;
+
+    // Size parameter affects bin spreading/smearing
+    if (size > 0.01f)
+        applySpectralSmear<NumChannels>(real, imag, nyquistBin, static_cast<int>(size * 10.0f));
+
+    // Band, decay and damping gains come from the cached curve, which stays
+    // float in either precision. Each gain is loaded once for all channels.
+    const float* gains = gainCurves[getGainCurveIndex(numBins)].gains;
+
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        const auto gain = static_cast<SampleType>(gains[bin]);
+
+        for (int channel = 0; channel < NumChannels; ++channel)
         {
-            channelData[sample] = (1.0f - wetDry) * dryData[sample] + wetDry * channelData[sample];
+            real[bin * NumChannels + channel] *= gain;
+            imag[bin * NumChannels + channel] *= gain;
         }
     }
 
-    // Update the spectrogram data for the GUI
-    updateSpectrogramBuffers();
+    // Density adds fluctuations that drift with the stream position
+    if (density > 0.01f)
+        densityModulator.apply<NumChannels>(real, imag, numBins, density, streamPosition);
+}
+
+void NewVerbTk1AudioProcessor::updateGainCurves(const StftEngine& engine) noexcept
+{
+    updateGainCurve(engine.getNumBins());
+
+    // A hybrid engine also hands over the spectra of its high band
+    if (engine.getLowLatencyFFTSize() > 0)
+        updateGainCurve(engine.getLowLatencyFFTSize() / 2 + 1);
 }
 
-void NewVerbTk1AudioProcessor::applySpectralProcessing(std::vector<std::complex<float>>& fftData)
+void NewVerbTk1AudioProcessor::updateGainCurve(int numBins) noexcept
 {
-    // Spectral processing based on our parameters
-    const int numBins = fftSize / 2;
-    const float lowCutoff = numBins * 0.1f; // 10% of spectrum
-    const float midCutoff = numBins * 0.4f; // 40% of spectrum
+    auto& curve = gainCurves[getGainCurveIndex(numBins)];
 
-    for (int i = 1; i < numBins; ++i)  // Skip DC
+    if (curve.lowBand == lowBand && curve.midBand == midBand && curve.highBand == highBand
+        && curve.damping == damping && curve.time == time)
+        return;
+
+    curve.lowBand = lowBand;
+    curve.midBand = midBand;
+    curve.highBand = highBand;
+    curve.damping = damping;
+    curve.time = time;
+
+    const int nyquistBin = numBins - 1;
+    const float lowCutoff = nyquistBin * 0.1f; // 10% of spectrum
+    const float midCutoff = nyquistBin * 0.4f; // 40% of spectrum
+
+    // Time parameter affects decay time of frequency bins
+    const float decayFactor = 1.0f - (1.0f / (time * 10.0f + 1.0f));
+
+    curve.gains[0] = 1.0f;
+    curve.gains[nyquistBin] = 1.0f;
+
+    for (int i = 1; i < nyquistBin; ++i)
     {
         // Determine which band this bin belongs to
         float bandMultiplier = 1.0f;
@@ -313,73 +889,214 @@ void NewVerbTk1AudioProcessor::applySpectralProcessing(std::vector<std::complex<
         else                            // High band
             bandMultiplier = highBand;
 
-        if (!freeze)
-        {
-            // Calculate magnitude and phase
-            float mag = std::abs(fftData[i]);
-            float phase = std::arg(fftData[i]);
-
-            // Apply spectral transformations based on parameters
-            // Size parameter affects bin spreading/smearing
-            if (size > 0.01f)
-            {
-                int spreadAmount = static_cast<int>(size * 10.0f);
-                if (spreadAmount > 0 && i + spreadAmount < numBins)
-                {
-                    for (int j = 1; j <= spreadAmount; ++j)
-                    {
-                        float spreadFactor = (spreadAmount - j + 1) / static_cast<float>(spreadAmount + 1);
-                        int targetBin = i + j;
-                        fftData[targetBin] += fftData[i] * spreadFactor * 0.3f;
-                    }
-                }
-            }
-
-            // Time parameter affects decay time of frequency bins
-            float decayFactor = 1.0f - (1.0f / (time * 10.0f + 1.0f));
-
-            // Damping affects higher frequencies more
-            float dampingFactor = 1.0f - (damping * float(i) / float(numBins));
-            dampingFactor = juce::jmax(0.01f, dampingFactor);
-
-            // Density adds random fluctuations
-            float densityFactor = 1.0f;
-            if (density > 0.01f)
-            {
-                float random = 0.5f + 0.5f * std::sin(i * 0.3f + juce::Time::getMillisecondCounter() * 0.001f);
-                densityFactor = 1.0f - (density * 0.3f * random);
-            }
-
-            // Apply all effects
-            float finalMultiplier = bandMultiplier * decayFactor * dampingFactor * densityFactor;
-
-            // Convert back to complex
-            fftData[i] *= finalMultiplier;
-
-            // Mirror to maintain symmetry for real signals
-            fftData[fftSize - i] = std::conj(fftData[i]);
-        }
+        // Damping affects higher frequencies more
+        float dampingFactor = 1.0f - (damping * float(i) / float(nyquistBin));
+        dampingFactor = juce::jmax(0.01f, dampingFactor);
+
+        curve.gains[i] = bandMultiplier * decayFactor * dampingFactor;
     }
 }
 
-void NewVerbTk1AudioProcessor::updateSpectrogramBuffers()
+size_t NewVerbTk1AudioProcessor::getGainCurveIndex(int numBins) noexcept
 {
-    juce::SpinLock::ScopedLockType scopedLock(spectralDataLock);
+    // numBins - 1 is half the FFT size, a power of two
+    const int order = juce::findHighestSetBit((juce::uint32) (numBins - 1)) + 1;
+    jassert(order >= minGainCurveOrder && order <= StftEngine::maxFFTOrder);
+
+    return (size_t) juce::jlimit(0, StftEngine::maxFFTOrder - minGainCurveOrder, order - minGainCurveOrder);
+}
 
-    // Calculate magnitude spectrum for visualization
-    for (int i = 0; i < fftSize / 2; ++i)
+template <int NumChannels, typename SampleType>
+void NewVerbTk1AudioProcessor::applySpectralSmear(SampleType* real, SampleType* imag, int nyquistBin, int spreadAmount) noexcept
+{
+    // Every source bin i adds 0.3 * (s - j + 1) / (s + 1) of its smeared value to
+    // bin i + j, for j = 1..s, and only bins whose whole spread stays below Nyquist
+    // act as sources. Rather than s taps per bin, carry two running sums over the
+    // last s sources, which both advance one bin in constant time:
+    //   weighted = sum of (s - j + 1) * y[k - j]
+    //   plain    = sum of y[k - j]
+    // The sums are kept in double so their add/subtract updates don't drift
+    // over thousands of bins. The recursion runs along the bins, so the
+    // interleaved channels are what goes into the SIMD lanes.
+    const int lastSource = nyquistBin - spreadAmount - 1;
+
+    if (spreadAmount <= 0 || lastSource < 1)
+        return;
+
+    // The recursion's loop gain is 0.15 * s. From s = 7 on that exceeds 1 and the
+    // spectrum grew without bound towards Nyquist, so the taps are scaled down to
+    // hold the loop gain just below 1. Smaller spreads are unchanged.
+    const double loopGain = juce::jmin(0.15 * spreadAmount, maxSmearLoopGain);
+    const double tapScale = 2.0 * loopGain / (spreadAmount * (spreadAmount + 1.0));
+    const double spread = spreadAmount;
+
+    std::array<double, NumChannels> weightedReal {}, weightedImag {};
+    std::array<double, NumChannels> plainReal {}, plainImag {};
+
+    for (int k = 1; k < nyquistBin; ++k)
     {
-        spectralMagnitudeBuffer[i] = std::abs(fftFrequencyDomainBuffer[i]);
+        const bool isSource = k <= lastSource;
+        const int leaving = k - spreadAmount;     // the source that drops out of reach of bin k + 1
+
+        for (int channel = 0; channel < NumChannels; ++channel)
+        {
+            SampleType& binReal = real[k * NumChannels + channel];
+            SampleType& binImag = imag[k * NumChannels + channel];
+
+            // Bin k is final once the sources below it have been added
+            binReal += static_cast<SampleType>(tapScale * weightedReal[channel]);
+            binImag += static_cast<SampleType>(tapScale * weightedImag[channel]);
+
+            const double sourceReal = isSource ? binReal : 0.0f;
+            const double sourceImag = isSource ? binImag : 0.0f;
+            const double leavingReal = leaving >= 1 ? real[leaving * NumChannels + channel] : 0.0f;
+            const double leavingImag = leaving >= 1 ? imag[leaving * NumChannels + channel] : 0.0f;
+
+            weightedReal[channel] += spread * sourceReal - plainReal[channel];
+            weightedImag[channel] += spread * sourceImag - plainImag[channel];
+            plainReal[channel] += sourceReal - leavingReal;
+            plainImag[channel] += sourceImag - leavingImag;
+        }
     }
 }
 
-void NewVerbTk1AudioProcessor::timerCallback()
+int NewVerbTk1AudioProcessor::getRequestedFFTOrder() const
+{
+    return StftEngine::minFFTOrder + juce::roundToInt(fftSizeParameter->load());
+}
+
+int NewVerbTk1AudioProcessor::getRequestedOverlap() const
+{
+    return 2 << juce::roundToInt(overlapParameter->load());
+}
+
+bool NewVerbTk1AudioProcessor::isLowLatencyRequested() const
+{
+    return lowLatencyParameter->load() > 0.5f;
+}
+
+void NewVerbTk1AudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    juce::ignoreUnused(parameterID, newValue);
+
+    // Engines are never built on the calling thread, which may be the audio thread
+    triggerAsyncUpdate();
+}
+
+void NewVerbTk1AudioProcessor::handleAsyncUpdate()
 {
-    // This is just to ensure we regularly update the UI with new spectral data
-    if (auto* editor = dynamic_cast<NewVerbTk1AudioProcessorEditor*>(getActiveEditor()))
+    deleteRetiredEngines();
+    updateTailLength();
+
+    const int switchedLatency = switchedEngineLatency.exchange(-1);
+
+    if (switchedLatency >= 0)
+        setLatencySamples(switchedLatency);
+
+    const int order = getRequestedFFTOrder();
+    const int overlap = getRequestedOverlap();
+    const bool lowLatency = isLowLatencyRequested();
+
+    // Nothing to do until prepareToPlay has run, which builds the engine itself
+    if (preparedNumChannels == 0
+        || (order == preparedFFTOrder && overlap == preparedOverlap && lowLatency == preparedLowLatency))
+        return;
+
+    preparedFFTOrder = order;
+    preparedOverlap = overlap;
+    preparedLowLatency = lowLatency;
+
+    auto engine = StftEngine::create(order, overlap, hopTracer, preparedDoublePrecision, lowLatency);
+    engine->prepare(preparedNumChannels);
+
+    // Replace any engine the audio thread has not picked up yet. Its latency is
+    // reported once the audio thread has switched to it.
+    delete pendingEngine.exchange(engine.release());
+}
+
+void NewVerbTk1AudioProcessor::deleteRetiredEngines()
+{
+    for (auto& slot : retiredEngines)
+        delete slot.exchange(nullptr);
+}
+
+bool NewVerbTk1AudioProcessor::loadImpulseResponse(const juce::File& file)
+{
+    delete retiredConvolver.exchange(nullptr);
+
+    // Not prepared yet: prepareToPlay builds the convolver for the right sample rate
+    if (preparedNumChannels == 0)
     {
-        editor->updateSpectrogramDisplay();
+        if (!file.existsAsFile())
+            return false;
+
+        impulseResponseFile = file;
+        return true;
     }
+
+    auto newConvolver = PartitionedConvolver::createFromFile(file, preparedSampleRate, preparedNumChannels);
+
+    if (newConvolver == nullptr)
+        return false;
+
+    impulseResponseFile = file;
+    preparedImpulseLength = newConvolver->getImpulseLength();
+    updateTailLength();
+
+    // Replace any convolver the audio thread has not picked up yet, and cancel an unload it hasn't seen
+    convolverUnloadRequested.store(false);
+    delete pendingConvolver.exchange(newConvolver.release());
+    return true;
+}
+
+void NewVerbTk1AudioProcessor::unloadImpulseResponse()
+{
+    delete retiredConvolver.exchange(nullptr);
+
+    impulseResponseFile = juce::File();
+    preparedImpulseLength = 0;
+    updateTailLength();
+
+    // Nothing is playing before prepareToPlay, so there is nothing to retire
+    delete pendingConvolver.exchange(nullptr);
+
+    if (preparedNumChannels > 0)
+        convolverUnloadRequested.store(true);
+}
+
+void NewVerbTk1AudioProcessor::setParallelChannelProcessing(bool shouldBeEnabled)
+{
+    if (parallelChannelProcessing.exchange(shouldBeEnabled) == shouldBeEnabled)
+        return;
+
+    // Starting or stopping threads must not overlap a processBlock call
+    suspendProcessing(true);
+    updateWorkerPool();
+    suspendProcessing(false);
+}
+
+void NewVerbTk1AudioProcessor::setPairedTransforms(bool shouldBeEnabled)
+{
+    // The audio thread passes it on to the engines at the start of each block
+    pairedTransforms.store(shouldBeEnabled);
+}
+
+void NewVerbTk1AudioProcessor::setAnalyserSettings(const SpectrumAnalyser::Settings& newSettings)
+{
+    spectrumAnalyser.setSettings(newSettings);
+}
+
+void NewVerbTk1AudioProcessor::updateWorkerPool()
+{
+    const int numWorkers = parallelChannelProcessing.load()
+        ? SpectralWorkerPool::getDefaultNumWorkers(preparedNumChannels)
+        : 0;
+
+    if (numWorkers == 0)
+        workerPool.reset();
+    else if (workerPool == nullptr || workerPool->getNumWorkers() != numWorkers
+             || workerPool->getBlockSize() != maxBlockSize || workerPool->getSampleRate() != preparedSampleRate)
+        workerPool = std::make_unique<SpectralWorkerPool>(numWorkers, maxBlockSize, preparedSampleRate);
 }
 
 //==============================================================================
@@ -397,19 +1114,78 @@ juce::AudioProcessorEditor* NewVerbTk1AudioProcessor::createEditor()
 void NewVerbTk1AudioProcessor::getStateInformation(juce::MemoryBlock& destData)
 {
     // Store current plugin state
-    auto state = parameters.copyState();
-    std::unique_ptr<juce::XmlElement> xml(state.createXml());
-    copyXmlToBinary(*xml, destData);
+    captureState().writeTo(destData);
 }
 
 void NewVerbTk1AudioProcessor::setStateInformation(const void* data, int sizeInBytes)
 {
-    // Restore plugin state
-    std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+    // Restore plugin state, falling back to the XML that earlier versions saved
+    PluginState state;
 
-    if (xmlState.get() != nullptr)
-        if (xmlState->hasTagName(parameters.state.getType()))
-            parameters.replaceState(juce::ValueTree::fromXml(*xmlState));
+    if (!state.readFrom(data, sizeInBytes))
+    {
+        std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
+
+        if (xmlState == nullptr || !state.readFromXml(*xmlState, parameters.state.getType()))
+            return;
+    }
+
+    applyState(state);
+}
+
+PluginState NewVerbTk1AudioProcessor::captureState() const
+{
+    PluginState state;
+
+    for (auto* parameterID : parameterIDs)
+        if (auto* parameter = parameters.getParameter(parameterID))
+            state.parameterValues.emplace_back(parameterID, parameter->convertFrom0to1(parameter->getValue()));
+
+    state.program = currentProgram;
+    state.parallelChannels = isParallelChannelProcessingEnabled();
+    state.pairedTransforms = arePairedTransformsEnabled();
+    state.analyserSettings = getAnalyserSettings();
+    state.impulseResponsePath = impulseResponseFile.getFullPathName();
+    return state;
+}
+
+void NewVerbTk1AudioProcessor::applyState(const PluginState& state)
+{
+    // A state is complete, so parameters it doesn't mention go back to their defaults
+    applyParameterValues(state.parameterValues, true);
+
+    currentProgram = juce::jlimit(0, juce::jmax(0, (int) presets.size() - 1), state.program);
+    setParallelChannelProcessing(state.parallelChannels);
+    setPairedTransforms(state.pairedTransforms);
+    setAnalyserSettings(state.analyserSettings);
+
+    // Without an impulse response in the state, or one that no longer loads, the
+    // current one must not keep playing
+    if (state.impulseResponsePath.isEmpty() || !loadImpulseResponse(juce::File(state.impulseResponsePath)))
+        unloadImpulseResponse();
+}
+
+void NewVerbTk1AudioProcessor::applyParameterValues(const PluginState::ParameterValues& values, bool resetOthersToDefault)
+{
+    // Bump the generation first, so the audio thread glides to the values below
+    // rather than jumping to whichever of them it sees first
+    presetGeneration.fetch_add(1);
+
+    for (auto* parameterID : parameterIDs)
+    {
+        auto* parameter = parameters.getParameter(parameterID);
+
+        if (parameter == nullptr)
+            continue;
+
+        const auto found = std::find_if(values.begin(), values.end(),
+                                        [parameterID](const auto& value) { return value.first == parameterID; });
+
+        if (found != values.end())
+            parameter->setValueNotifyingHost(parameter->convertTo0to1(found->second));
+        else if (resetOthersToDefault)
+            parameter->setValueNotifyingHost(parameter->getDefaultValue());
+    }
 }
 
 //==============================================================================
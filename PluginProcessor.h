@@ -1,6 +1,14 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SpectralWorkArena.h"
+#include "StftEngine.h"
+#include "PartitionedConvolver.h"
+#include "DensityModulator.h"
+#include "SpectralKernels.h"
+#include "SpectrumAnalyser.h"
+#include "ProcessLoadMonitor.h"
+#include "PluginState.h"
 
 //==============================================================================
 /**
@@ -8,7 +16,9 @@
  * A spectral processing reverb plugin with customizable frequency manipulation.
  */
 class NewVerbTk1AudioProcessor : public juce::AudioProcessor,
-    private juce::Timer
+    private juce::AsyncUpdater,
+    private juce::AudioProcessorValueTreeState::Listener,
+    private StftEngine::FrameCallback
 {
 public:
     //==============================================================================
@@ -21,7 +31,11 @@ public:
 
     bool isBusesLayoutSupported(const BusesLayout& layouts) const override;
 
+    // Both precisions are processed natively; the host's choice, made before
+    // prepareToPlay, decides which sample type the engines and buffers use
+    bool supportsDoublePrecisionProcessing() const override;
     void processBlock(juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock(juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -60,17 +74,59 @@ public:
         MID_BAND,
         HIGH_BAND,
         FREEZE,
+        FFT_SIZE,
+        OVERLAP,
+        CONV_MIX,
+        LOW_LATENCY,
         TOTAL_NUM_PARAMS
     };
 
-    // FFT Parameters
-    static constexpr int fftOrder = 12;
-    static constexpr int fftSize = 1 << fftOrder;
-    static constexpr int hopSize = fftSize / 4;
+    // FFT Parameters. The size and overlap are chosen at runtime through the
+    // "fft_size" and "overlap" parameters; these are their defaults. The
+    // "low_latency" parameter (named for what the mode first did; shown as
+    // "Hybrid FFT") moves the high band to a small FFT for sharper transients,
+    // at the same latency (see StftEngine::create).
+    static constexpr int defaultFFTOrder = 12;
+    static constexpr int defaultOverlap = 4;
 
-    // For editor to access spectral data
-    const float* getSpectralMagnitudeBuffer() const { return spectralMagnitudeBuffer.data(); }
-    int getFFTSize() const { return fftSize; }
+    // For editor to access spectral data. Input and output are analysed on a
+    // background thread, and the audio thread only feeds it while spectrum
+    // publishing is enabled, i.e. while an editor is showing the frames.
+    SpectrumTripleBuffer& getSpectrumBuffer() noexcept { return spectrumAnalyser.getSpectrumBuffer(); }
+    void setSpectrumPublishingEnabled(bool shouldPublish) { spectrumAnalyser.setEnabled(shouldPublish); }
+
+    // Resolution and averaging of the analyser. Call from the message thread;
+    // the settings are saved with the plugin state.
+    void setAnalyserSettings(const SpectrumAnalyser::Settings& newSettings);
+    SpectrumAnalyser::Settings getAnalyserSettings() const { return spectrumAnalyser.getSettings(); }
+
+    // Block timing against the real-time deadline, hop counts and sample
+    // health, readable from any thread
+    ProcessLoadMonitor& getLoadMonitor() noexcept { return loadMonitor; }
+
+    // Per-stage begin/end events of every block and hop, written to a Chrome
+    // trace file between startTracing() and stopTracing()
+    HopTracer& getHopTracer() noexcept { return hopTracer; }
+
+    // Runs the channels' STFT hops concurrently on a small worker pool.
+    // Call from the message thread; the setting is saved with the plugin state.
+    void setParallelChannelProcessing(bool shouldBeEnabled);
+    bool isParallelChannelProcessingEnabled() const { return parallelChannelProcessing.load(); }
+
+    // Runs each pair of channels (L/R of a stereo bus) through one complex FFT
+    // instead of two real ones. On by default. Call from the message thread;
+    // the setting is saved with the plugin state.
+    void setPairedTransforms(bool shouldBeEnabled);
+    bool arePairedTransformsEnabled() const { return pairedTransforms.load(); }
+
+    // Loads an impulse response for the convolution reverb. Call from the message
+    // thread; the file is remembered with the plugin state. Returns false, keeping
+    // the current impulse response, if the file can't be read.
+    bool loadImpulseResponse(const juce::File& file);
+    juce::File getImpulseResponseFile() const { return impulseResponseFile; }
+
+    // Removes the impulse response, silencing the convolution reverb. Call from the message thread.
+    void unloadImpulseResponse();
 
     // Audio parameter tree
     juce::AudioProcessorValueTreeState parameters;
@@ -78,11 +134,14 @@ public:
 private:
     //==============================================================================
     // Private FFT processing methods
-    void timerCallback() override;
-    void updateSpectrogramBuffers();
+    void handleAsyncUpdate() override;
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+    void processSpectra(float* real, float* imag, int numBins, int numChannels, int firstChannel, juce::int64 streamPosition) override;
+    void processSpectra(double* real, double* imag, int numBins, int numChannels, int firstChannel, juce::int64 streamPosition) override;
 
     // Parameter connections
-    float wetDry, time, density, damping, size, lowBand, midBand, highBand, freeze;
+    float wetDry, time, density, damping, size, lowBand, midBand, highBand, freeze, convMix;
+    static constexpr int numGlidingParameters = 9;      // all of the above but freeze
     std::atomic<float>* wetDryParameter = nullptr;
     std::atomic<float>* timeParameter = nullptr;
     std::atomic<float>* densityParameter = nullptr;
@@ -92,31 +151,192 @@ private:
     std::atomic<float>* midBandParameter = nullptr;
     std::atomic<float>* highBandParameter = nullptr;
     std::atomic<float>* freezeParameter = nullptr;
+    std::atomic<float>* fftSizeParameter = nullptr;
+    std::atomic<float>* overlapParameter = nullptr;
+    std::atomic<float>* convMixParameter = nullptr;
+    std::atomic<float>* lowLatencyParameter = nullptr;
+
+    // Factory presets, built once so that setCurrentProgram() only sets parameters.
+    // They leave the FFT size, overlap and hybrid mode alone, so a preset
+    // change never has to rebuild the engine.
+    struct Preset
+    {
+        juce::String name;
+        PluginState::ParameterValues parameterValues;
+    };
+
+    std::vector<Preset> presets;
+    int currentProgram = 0;                             // message thread
+
+    // A preset or state change bumps presetGeneration before setting any
+    // parameter. The audio thread then glides the continuous parameters from
+    // the values it last used to the new ones over presetCrossfadeLength
+    // samples instead of jumping. The spectral parameters take the glide's
+    // value at the start of each block; the mix gains ramp sample by sample
+    // from wetDry and convMix to where the glide is at the end of the block.
+    std::atomic<juce::uint32> presetGeneration { 0 };
+    juce::uint32 appliedPresetGeneration = 0;
+    int presetCrossfadeRemaining = 0;
+    std::array<float, numGlidingParameters> presetCrossfadeStart {};
+    float wetDryEnd = 0.0f, convMixEnd = 0.0f;
+    static constexpr int presetCrossfadeLength = 2048;
+
+    // A gain ramping from start to end over a block of blockLength samples, at offset
+    static float getRampedGain(float start, float end, int offset, int blockLength) noexcept
+    {
+        return blockLength > 0 ? start + (end - start) * (float) offset / (float) blockLength : end;
+    }
+
+    // Declared ahead of the engines, which hold on to it
+    HopTracer hopTracer;
+
+    // STFT analysis/resynthesis. stftEngine and fadingEngine belong to the audio
+    // thread. Replacements are built and prepared on the message thread and handed
+    // over through pendingEngine; the audio thread crossfades to them and hands
+    // the old engine back through retiredEngines for the message thread to delete.
+    std::unique_ptr<StftEngine> stftEngine;
+    std::unique_ptr<StftEngine> fadingEngine;
+    std::atomic<StftEngine*> pendingEngine { nullptr };
+    std::array<std::atomic<StftEngine*>, 4> retiredEngines {};
+    int engineWarmupRemaining = 0;
+    int engineCrossfadeRemaining = 0;
+
+    // Set by the audio thread when it switches to a pending engine, so that the
+    // message thread reports that engine's latency only once it is playing; -1 otherwise
+    std::atomic<int> switchedEngineLatency { -1 };
 
-    // FFT objects
-    juce::dsp::FFT forwardFFT;
-    juce::dsp::FFT inverseFFT;
+    int preparedFFTOrder = 0, preparedOverlap = 0;      // message thread
+    bool preparedDoublePrecision = false;
+    bool preparedLowLatency = false;                    // message thread
+    static constexpr int engineCrossfadeLength = 1024;
 
-    // Processing buffers
-    juce::AudioBuffer<float> fftInputBuffer;
-    juce::AudioBuffer<float> fftOutputBuffer;
+    // Convolution reverb, handed over the same way: built on the message thread,
+    // published through pendingConvolver and returned through retiredConvolver
+    std::unique_ptr<PartitionedConvolver> convolver;
+    std::atomic<PartitionedConvolver*> pendingConvolver { nullptr };
+    std::atomic<PartitionedConvolver*> retiredConvolver { nullptr };
+    std::atomic<bool> convolverUnloadRequested { false };  // retire the convolver without a replacement
+    juce::File impulseResponseFile;                     // message thread, empty unless the file loads
+    int preparedImpulseLength = 0;                      // message thread, 0 without a convolver
+    double preparedSampleRate = 0.0;
 
-    std::vector<float> fftWorkingBuffer;
-    std::vector<float> windowBuffer;
-    std::vector<float> spectralMagnitudeBuffer;
+    // The wet path has no feedback, so once the input has been below
+    // silenceThreshold for longer than the engine and convolver tails its output
+    // is silent, and the audio thread skips the STFT and convolver entirely until
+    // the input returns. getTailLengthSeconds() reports the same tail to the host.
+    static constexpr double silenceThreshold = 1.0e-5;  // -100 dBFS
+    juce::int64 silentInputSamples = 0;
+    bool wetPathAsleep = false;
+    std::atomic<double> tailLengthSeconds { 0.0 };
 
-    std::vector<std::complex<float>> fftTimeDomainBuffer;
-    std::vector<std::complex<float>> fftFrequencyDomainBuffer;
-    std::vector<std::complex<float>> fftConvolutionBuffer;
+    std::unique_ptr<SpectralWorkerPool> workerPool;
+    std::atomic<bool> parallelChannelProcessing { false };
+    std::atomic<bool> pairedTransforms { true };
+    int preparedNumChannels = 0;
 
-    // Internal processing state
-    juce::SpinLock spectralDataLock;
-    int fifoIndex = 0;
-    bool nextFFTBlockReady = false;
+    // Processing buffers. Everything the audio thread touches is carved out of
+    // workArena in prepareToPlay, so processBlock never allocates.
+    SpectralWorkArena workArena;
+    int maxBlockSize = 0;
+
+    // The buffers that follow the host's sample type. Only the set for the
+    // precision chosen in prepareToPlay is allocated.
+    template <typename SampleType>
+    struct SliceBuffers
+    {
+        juce::AudioBuffer<SampleType> dry;
+        juce::AudioBuffer<SampleType> fadingEngine;         // input/output of the engine being faded out
+        juce::AudioBuffer<SampleType> dryHistory;           // see dryHistoryMask
+        SampleType* engineCrossfadeGains = nullptr;         // maxBlockSize
+
+        void release()
+        {
+            dry.setSize(0, 0);
+            fadingEngine.setSize(0, 0);
+            dryHistory.setSize(0, 0);
+            engineCrossfadeGains = nullptr;
+        }
+    };
+
+    SliceBuffers<float> floatBuffers;
+    SliceBuffers<double> doubleBuffers;
+
+    template <typename SampleType> SliceBuffers<SampleType>& getSliceBuffers() noexcept;
+
+    // The convolver only works in float, so its input/output stays float in either precision
+    juce::AudioBuffer<float> convolutionBuffer;
+
+    // Per-bin gain (band x decay x damping) for one FFT size, from the
+    // hybrid engine's high band up to the largest engine. Only depends on
+    // parameters and bin index, so it is rebuilt when those parameters change
+    // rather than on every hop.
+    struct GainCurve
+    {
+        float* gains = nullptr;         // numBins, unity at DC and Nyquist
+        int numBins = 0;
+        float lowBand = -1.0f, midBand = -1.0f, highBand = -1.0f, damping = -1.0f, time = -1.0f;
+    };
+
+    static constexpr int minGainCurveOrder = StftEngine::lowLatencyFFTOrder;
+    std::array<GainCurve, StftEngine::maxFFTOrder - minGainCurveOrder + 1> gainCurves;
+
+    DensityModulator densityModulator;
+    static constexpr juce::uint32 densityModulationSeed = 0x4e565431;
+
+    // The dry signal is delayed by the engine latency so it stays aligned with
+    // the wet path, through the dryHistory ring of the active SliceBuffers
+    int dryHistoryMask = 0;
+    int dryHistoryPosition = 0;
+
+    // Input and output spectra for the editor, measured off the audio thread
+    SpectrumAnalyser spectrumAnalyser;
+
+    ProcessLoadMonitor loadMonitor;
 
     // Helper methods
     juce::AudioProcessorValueTreeState::ParameterLayout createParameters();
-    void applySpectralProcessing(std::vector<std::complex<float>>& fftData);
+    void createPresets();
+    PluginState captureState() const;
+    void applyState(const PluginState& state);
+    void applyParameterValues(const PluginState::ParameterValues& values, bool resetOthersToDefault);
+    void loadParameterValues(int numSamples) noexcept;
+    template <typename SampleType>
+    void applySpectralProcessing(SampleType* real, SampleType* imag, int numBins, int numChannels, juce::int64 streamPosition) noexcept;
+    template <int NumChannels, typename SampleType>
+    void applySpectralProcessing(SampleType* real, SampleType* imag, int numBins, juce::int64 streamPosition) noexcept;
+    template <int NumChannels, typename SampleType>
+    static void applySpectralSmear(SampleType* real, SampleType* imag, int nyquistBin, int spreadAmount) noexcept;
+    static constexpr double maxSmearLoopGain = 0.9;
+    void updateWorkerPool();
+
+    int getRequestedFFTOrder() const;
+    int getRequestedOverlap() const;
+    bool isLowLatencyRequested() const;
+    void deleteRetiredEngines();
+    void takePendingEngine() noexcept;
+    template <typename SampleType>
+    void allocateSliceBuffers(int numChannels, int dryHistorySize);
+    template <typename SampleType>
+    void processBlockWithSampleType(juce::AudioBuffer<SampleType>& buffer) noexcept;
+    template <typename SampleType>
+    void processWetSlice(juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept;
+    template <typename SampleType>
+    void pushDryHistory(const juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept;
+    template <typename SampleType, typename DestType>
+    void readDryHistory(juce::AudioBuffer<DestType>& dest, int numSamples, int delay) noexcept;
+    template <typename SampleType>
+    void readDelayedDry(int sliceLength) noexcept;
+    void advanceEngineCrossfade(int sliceLength) noexcept;
+    template <typename SampleType>
+    bool updateWetPathSleep(const juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept;
+    static int getWetTailSamples(int fftSize, int engineLatency, int impulseLength) noexcept;
+    void updateTailLength();
+    void takePendingConvolver() noexcept;
+    void updateGainCurves(const StftEngine& engine) noexcept;
+    void updateGainCurve(int numBins) noexcept;
+    static size_t getGainCurveIndex(int numBins) noexcept;
+    template <typename SampleType>
+    void processConvolutionSlice(juce::AudioBuffer<SampleType>& buffer, int sliceStart, int sliceLength) noexcept;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(NewVerbTk1AudioProcessor)
 };
\ No newline at end of file
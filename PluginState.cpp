@@ -0,0 +1,121 @@
+﻿#include "PluginState.h"
+
+//==============================================================================
+namespace
+{
+    // magic, version, payload size
+    constexpr int headerSize = 12;
+
+    // Far more than the plugin has, to reject corrupt counts before reserving for them
+    constexpr int maxParameters = 1024;
+}
+
+void PluginState::writeTo(juce::MemoryBlock& destData) const
+{
+    juce::MemoryOutputStream stream(destData, false);
+
+    stream.writeInt((int) magic);
+    stream.writeInt(currentVersion);
+    stream.writeInt(0);                                 // payload size, filled in below
+
+    // Version 1
+    stream.writeInt((int) parameterValues.size());
+
+    for (const auto& parameter : parameterValues)
+    {
+        stream.writeString(parameter.first);
+        stream.writeFloat(parameter.second);
+    }
+
+    stream.writeInt(program);
+    stream.writeBool(parallelChannels);
+    stream.writeBool(pairedTransforms);
+    stream.writeInt(analyserSettings.fftOrder);
+    stream.writeInt(analyserSettings.overlap);
+    stream.writeInt((int) analyserSettings.averaging);
+    stream.writeFloat(analyserSettings.averagingTimeSeconds);
+    stream.writeBool(analyserSettings.peakHold);
+    stream.writeFloat(analyserSettings.peakDecayDbPerSecond);
+    stream.writeString(impulseResponsePath);
+
+    const auto end = stream.getPosition();
+    stream.setPosition(headerSize - 4);
+    stream.writeInt((int) (end - headerSize));
+    stream.setPosition(end);
+}
+
+bool PluginState::readFrom(const void* data, int sizeInBytes)
+{
+    if (data == nullptr || sizeInBytes < headerSize)
+        return false;
+
+    juce::MemoryInputStream stream(data, (size_t) sizeInBytes, false);
+
+    if ((juce::uint32) stream.readInt() != magic)
+        return false;
+
+    // Newer versions only append, so their leading fields are still ours
+    const int version = stream.readInt();
+    const int payloadSize = stream.readInt();
+
+    if (version < 1 || payloadSize < 0 || payloadSize > stream.getNumBytesRemaining())
+        return false;
+
+    PluginState state;
+    const int numParameters = stream.readInt();
+
+    if (numParameters < 0 || numParameters > maxParameters)
+        return false;
+
+    state.parameterValues.reserve((size_t) numParameters);
+
+    for (int i = 0; i < numParameters; ++i)
+    {
+        auto parameterID = stream.readString();
+        state.parameterValues.emplace_back(std::move(parameterID), stream.readFloat());
+    }
+
+    state.program = stream.readInt();
+    state.parallelChannels = stream.readBool();
+    state.pairedTransforms = stream.readBool();
+    state.analyserSettings.fftOrder = stream.readInt();
+    state.analyserSettings.overlap = stream.readInt();
+    state.analyserSettings.averaging = (SpectrumAnalyser::Averaging) juce::jlimit(0, 2, stream.readInt());
+    state.analyserSettings.averagingTimeSeconds = stream.readFloat();
+    state.analyserSettings.peakHold = stream.readBool();
+    state.analyserSettings.peakDecayDbPerSecond = stream.readFloat();
+    state.impulseResponsePath = stream.readString();
+
+    // A truncated payload runs into the end of the data
+    if (stream.getPosition() > headerSize + payloadSize)
+        return false;
+
+    *this = std::move(state);
+    return true;
+}
+
+bool PluginState::readFromXml(const juce::XmlElement& xml, const juce::Identifier& stateType)
+{
+    if (!xml.hasTagName(stateType.toString()))
+        return false;
+
+    PluginState state;
+
+    for (auto* parameter : xml.getChildWithTagNameIterator("PARAM"))
+        state.parameterValues.emplace_back(parameter->getStringAttribute("id"), (float) parameter->getDoubleAttribute("value"));
+
+    const SpectrumAnalyser::Settings defaults;
+    state.program = xml.getIntAttribute("program", 0);
+    state.parallelChannels = xml.getBoolAttribute("parallelChannels", false);
+    state.pairedTransforms = xml.getBoolAttribute("pairedTransforms", true);
+    state.analyserSettings.fftOrder = xml.getIntAttribute("analyserFFTOrder", defaults.fftOrder);
+    state.analyserSettings.overlap = xml.getIntAttribute("analyserOverlap", defaults.overlap);
+    state.analyserSettings.averaging = (SpectrumAnalyser::Averaging) juce::jlimit(0, 2, xml.getIntAttribute("analyserAveraging", (int) defaults.averaging));
+    state.analyserSettings.averagingTimeSeconds = (float) xml.getDoubleAttribute("analyserAveragingTime", defaults.averagingTimeSeconds);
+    state.analyserSettings.peakHold = xml.getBoolAttribute("analyserPeakHold", defaults.peakHold);
+    state.analyserSettings.peakDecayDbPerSecond = (float) xml.getDoubleAttribute("analyserPeakDecay", defaults.peakDecayDbPerSecond);
+    state.impulseResponsePath = xml.getStringAttribute("impulseResponse");
+
+    *this = std::move(state);
+    return true;
+}
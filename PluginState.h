@@ -0,0 +1,45 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SpectrumAnalyser.h"
+
+//==============================================================================
+/**
+ * PluginState
+ * Everything getStateInformation() saves, and its compact binary form.
+ *
+ * The binary form is a magic number, a format version and the payload size,
+ * followed by the parameter values as ID/value pairs and then the remaining
+ * settings. Later versions only append fields, so a reader takes the fields
+ * it knows from any version and leaves the rest at their defaults; parameter
+ * IDs it doesn't know are skipped when the state is applied.
+ *
+ * Reading builds neither an XML document nor a ValueTree, which is what made
+ * restoring sessions with many instances slow. States that earlier versions
+ * saved as the parameter tree's XML are read with readFromXml().
+ */
+struct PluginState
+{
+    static constexpr juce::uint32 magic = 0x5354564e;   // "NVTS"
+    static constexpr int currentVersion = 1;
+
+    // Parameter IDs with their real (not normalised) values
+    using ParameterValues = std::vector<std::pair<juce::String, float>>;
+
+    ParameterValues parameterValues;
+    int program = 0;
+    bool parallelChannels = false;
+    bool pairedTransforms = true;
+    SpectrumAnalyser::Settings analyserSettings;
+    juce::String impulseResponsePath;                   // empty without an impulse response
+
+    //==============================================================================
+    void writeTo(juce::MemoryBlock& destData) const;
+
+    // Returns false, leaving the state untouched, unless data holds a binary state
+    bool readFrom(const void* data, int sizeInBytes);
+
+    // Reads the parameter tree that earlier versions saved as XML. Returns false,
+    // leaving the state untouched, if xml isn't a tree of the given type.
+    bool readFromXml(const juce::XmlElement& xml, const juce::Identifier& stateType);
+};
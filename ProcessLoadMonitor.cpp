@@ -0,0 +1,176 @@
+﻿#include "ProcessLoadMonitor.h"
+
+//==============================================================================
+float ProcessLoadMonitor::Snapshot::getLoadPercentile(double fraction) const noexcept
+{
+    juce::uint64 total = 0;
+
+    for (auto count : histogram)
+        total += count;
+
+    if (total == 0)
+        return 0.0f;
+
+    // Report the upper edge of the bin the percentile falls into
+    const auto target = (juce::uint64) std::ceil(juce::jlimit(0.0, 1.0, fraction) * (double) total);
+    juce::uint64 seen = 0;
+
+    for (int bin = 0; bin < numHistogramBins; ++bin)
+    {
+        seen += histogram[(size_t) bin];
+
+        if (seen >= target && seen > 0)
+            return (float) ((bin + 1) * histogramRange / numHistogramBins);
+    }
+
+    return (float) histogramRange;
+}
+
+float ProcessLoadMonitor::Snapshot::getAverageLoadSince(const Snapshot& earlier) const noexcept
+{
+    const double audioElapsed = audioSeconds - earlier.audioSeconds;
+
+    // A reset in between makes the differences meaningless
+    if (audioElapsed <= 0.0 || busySeconds < earlier.busySeconds)
+        return lastLoad;
+
+    return (float) ((busySeconds - earlier.busySeconds) / audioElapsed);
+}
+
+//==============================================================================
+void ProcessLoadMonitor::prepare(double sampleRate) noexcept
+{
+    currentSampleRate = sampleRate > 0.0 ? sampleRate : 44100.0;
+    reset();
+}
+
+ProcessLoadMonitor::Snapshot ProcessLoadMonitor::getSnapshot() const noexcept
+{
+    Snapshot snapshot;
+    snapshot.numBlocks = numBlocks.load(std::memory_order_relaxed);
+    snapshot.numHops = numHops.load(std::memory_order_relaxed);
+    snapshot.numOverruns = numOverruns.load(std::memory_order_relaxed);
+    snapshot.numDenormalBlocks = numDenormalBlocks.load(std::memory_order_relaxed);
+    snapshot.numNonFiniteBlocks = numNonFiniteBlocks.load(std::memory_order_relaxed);
+    snapshot.busySeconds = busySeconds.load(std::memory_order_relaxed);
+    snapshot.audioSeconds = audioSeconds.load(std::memory_order_relaxed);
+    snapshot.lastLoad = lastLoad.load(std::memory_order_relaxed);
+    snapshot.peakLoad = peakLoad.load(std::memory_order_relaxed);
+
+    for (size_t bin = 0; bin < histogram.size(); ++bin)
+        snapshot.histogram[bin] = histogram[bin].load(std::memory_order_relaxed);
+
+    return snapshot;
+}
+
+void ProcessLoadMonitor::clear() noexcept
+{
+    for (auto* counter : { &numBlocks, &numHops, &numOverruns, &numDenormalBlocks, &numNonFiniteBlocks })
+        counter->store(0, std::memory_order_relaxed);
+
+    busySeconds.store(0.0, std::memory_order_relaxed);
+    audioSeconds.store(0.0, std::memory_order_relaxed);
+    lastLoad.store(0.0f, std::memory_order_relaxed);
+    peakLoad.store(0.0f, std::memory_order_relaxed);
+
+    for (auto& bin : histogram)
+        bin.store(0, std::memory_order_relaxed);
+}
+
+//==============================================================================
+namespace
+{
+    // The IEEE 754 layout of each sample type
+    template <typename SampleType> struct SampleBits;
+
+    template <> struct SampleBits<float>
+    {
+        using Type = juce::uint32;
+        static constexpr Type exponentMask = 0x7f800000u;
+        static constexpr Type mantissaMask = 0x007fffffu;
+    };
+
+    template <> struct SampleBits<double>
+    {
+        using Type = juce::uint64;
+        static constexpr Type exponentMask = 0x7ff0000000000000ull;
+        static constexpr Type mantissaMask = 0x000fffffffffffffull;
+    };
+}
+
+template <typename SampleType>
+int ProcessLoadMonitor::scanSamples(const juce::AudioBuffer<SampleType>& buffer, int numChannels) noexcept
+{
+    using Bits = SampleBits<SampleType>;
+    using BitType = typename Bits::Type;
+
+    // Classify by exponent bits: all zeros with a mantissa is denormal, all ones
+    // is NaN or infinity. ORing the tests keeps the loop branch-free.
+    int flags = 0;
+
+    for (int channel = 0; channel < juce::jmin(numChannels, buffer.getNumChannels()); ++channel)
+    {
+        const SampleType* data = buffer.getReadPointer(channel);
+        BitType anyDenormal = 0, anyNonFinite = 0;
+
+        for (int i = 0; i < buffer.getNumSamples(); ++i)
+        {
+            BitType bits;
+            std::memcpy(&bits, data + i, sizeof(bits));
+
+            const BitType exponent = bits & Bits::exponentMask;
+            anyDenormal |= (BitType) (exponent == 0 && (bits & Bits::mantissaMask) != 0);
+            anyNonFinite |= (BitType) (exponent == Bits::exponentMask);
+        }
+
+        flags |= (anyDenormal != 0 ? hasDenormal : 0) | (anyNonFinite != 0 ? hasNonFinite : 0);
+    }
+
+    return flags;
+}
+
+template <typename SampleType>
+juce::int64 ProcessLoadMonitor::beginBlock(const juce::AudioBuffer<SampleType>& input, int numChannels) noexcept
+{
+    if (resetRequested.exchange(false, std::memory_order_relaxed))
+        clear();
+
+    if ((scanSamples(input, numChannels) & hasDenormal) != 0)
+        increment(numDenormalBlocks);
+
+    return juce::Time::getHighResolutionTicks();
+}
+
+template <typename SampleType>
+void ProcessLoadMonitor::endBlock(juce::int64 startTicks, const juce::AudioBuffer<SampleType>& output, int numChannels) noexcept
+{
+    const double elapsed = (double) (juce::Time::getHighResolutionTicks() - startTicks) * secondsPerTick;
+    const double deadline = output.getNumSamples() / currentSampleRate;
+
+    if ((scanSamples(output, numChannels) & hasNonFinite) != 0)
+        increment(numNonFiniteBlocks);
+
+    if (deadline <= 0.0)
+        return;
+
+    const auto load = (float) (elapsed / deadline);
+    const int bin = juce::jlimit(0, numHistogramBins - 1, (int) (load * (numHistogramBins / histogramRange)));
+
+    increment(histogram[(size_t) bin]);
+    increment(numBlocks);
+
+    if (load > 1.0f)
+        increment(numOverruns);
+
+    busySeconds.store(busySeconds.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+    audioSeconds.store(audioSeconds.load(std::memory_order_relaxed) + deadline, std::memory_order_relaxed);
+    lastLoad.store(load, std::memory_order_relaxed);
+
+    if (load > peakLoad.load(std::memory_order_relaxed))
+        peakLoad.store(load, std::memory_order_relaxed);
+}
+
+template juce::int64 ProcessLoadMonitor::beginBlock(const juce::AudioBuffer<float>&, int) noexcept;
+template juce::int64 ProcessLoadMonitor::beginBlock(const juce::AudioBuffer<double>&, int) noexcept;
+template void ProcessLoadMonitor::endBlock(juce::int64, const juce::AudioBuffer<float>&, int) noexcept;
+template void ProcessLoadMonitor::endBlock(juce::int64, const juce::AudioBuffer<double>&, int) noexcept;
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * ProcessLoadMonitor
+ * Measures how much of the real-time budget each processBlock call uses.
+ *
+ * The audio thread is the only writer. Every block, its wall time is divided by
+ * the block's own deadline (numSamples / sampleRate) and counted into a fixed
+ * histogram, and the input and output are scanned for denormal and non-finite
+ * samples. Everything is kept in relaxed atomics, so any thread can take a
+ * Snapshot at any time without locking; a snapshot may straddle a block, which
+ * is fine for a meter.
+ */
+class ProcessLoadMonitor
+{
+public:
+    //==============================================================================
+    // The histogram covers loads of 0 to 200% of the deadline; the last bin also
+    // counts everything above
+    static constexpr int numHistogramBins = 64;
+    static constexpr double histogramRange = 2.0;
+
+    struct Snapshot
+    {
+        juce::uint64 numBlocks = 0;
+        juce::uint64 numHops = 0;
+        juce::uint64 numOverruns = 0;               // blocks that took longer than their deadline
+        juce::uint64 numDenormalBlocks = 0;         // blocks with denormal input samples
+        juce::uint64 numNonFiniteBlocks = 0;        // blocks with NaN or infinite output samples
+        double busySeconds = 0.0;                   // total time spent in processBlock
+        double audioSeconds = 0.0;                  // total audio time processed
+        float lastLoad = 0.0f;                      // 1.0 = the whole deadline
+        float peakLoad = 0.0f;
+        std::array<juce::uint64, numHistogramBins> histogram {};
+
+        // Load at or below which the given fraction (0 to 1) of blocks finished
+        float getLoadPercentile(double fraction) const noexcept;
+
+        // Busy time over audio time since an earlier snapshot
+        float getAverageLoadSince(const Snapshot& earlier) const noexcept;
+    };
+
+    //==============================================================================
+    ProcessLoadMonitor() = default;
+
+    // Call from prepareToPlay
+    void prepare(double sampleRate) noexcept;
+
+    // Clears every statistic. Safe from any thread; the audio thread applies it
+    // at the start of its next block.
+    void reset() noexcept { resetRequested.store(true, std::memory_order_relaxed); }
+
+    Snapshot getSnapshot() const noexcept;
+
+    //==============================================================================
+    // Audio thread: brackets one processBlock call, in either precision
+    template <typename SampleType>
+    juce::int64 beginBlock(const juce::AudioBuffer<SampleType>& input, int numChannels) noexcept;
+    template <typename SampleType>
+    void endBlock(juce::int64 startTicks, const juce::AudioBuffer<SampleType>& output, int numChannels) noexcept;
+
+    // Audio thread (or a worker it is waiting for): counts processed STFT hops
+    void addHops(int numHopsProcessed) noexcept { numHops.fetch_add((juce::uint64) numHopsProcessed, std::memory_order_relaxed); }
+
+private:
+    //==============================================================================
+    enum SampleFlags
+    {
+        hasDenormal = 1,
+        hasNonFinite = 2
+    };
+
+    template <typename SampleType>
+    static int scanSamples(const juce::AudioBuffer<SampleType>& buffer, int numChannels) noexcept;
+    void clear() noexcept;
+
+    // Single writer, so increments are a relaxed load and store rather than a locked add
+    static void increment(std::atomic<juce::uint64>& counter, juce::uint64 amount = 1) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    double secondsPerTick = 1.0 / (double) juce::Time::getHighResolutionTicksPerSecond();
+    double currentSampleRate = 44100.0;
+    std::atomic<bool> resetRequested { false };
+
+    std::atomic<juce::uint64> numBlocks { 0 }, numHops { 0 }, numOverruns { 0 };
+    std::atomic<juce::uint64> numDenormalBlocks { 0 }, numNonFiniteBlocks { 0 };
+    std::atomic<double> busySeconds { 0.0 }, audioSeconds { 0.0 };
+    std::atomic<float> lastLoad { 0.0f }, peakLoad { 0.0f };
+    std::array<std::atomic<juce::uint64>, numHistogramBins> histogram {};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ProcessLoadMonitor)
+};
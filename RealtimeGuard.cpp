@@ -0,0 +1,94 @@
+﻿#include "RealtimeGuard.h"
+
+#include <cstdlib>
+#include <new>
+
+#if NEWVERB_ALLOCATION_GUARD
+
+//==============================================================================
+namespace
+{
+    thread_local int realtimeGuardDepth = 0;
+
+    void checkAllocationIsAllowed() noexcept
+    {
+        if (realtimeGuardDepth > 0)
+        {
+            // Drop the guard while asserting, as the assertion handler itself may allocate
+            const auto depth = realtimeGuardDepth;
+            realtimeGuardDepth = 0;
+
+            // If you hit this, something allocated or freed memory on the audio thread.
+            // Check the call stack, then move the allocation into prepareToPlay.
+            jassertfalse;
+
+            realtimeGuardDepth = depth;
+        }
+    }
+
+    void* allocateChecked(std::size_t size)
+    {
+        checkAllocationIsAllowed();
+
+        if (auto* ptr = std::malloc(size != 0 ? size : 1))
+            return ptr;
+
+        throw std::bad_alloc();
+    }
+
+    void freeChecked(void* ptr) noexcept
+    {
+        if (ptr != nullptr)
+        {
+            checkAllocationIsAllowed();
+            std::free(ptr);
+        }
+    }
+}
+
+//==============================================================================
+ScopedRealtimeAllocationGuard::ScopedRealtimeAllocationGuard() noexcept { ++realtimeGuardDepth; }
+ScopedRealtimeAllocationGuard::~ScopedRealtimeAllocationGuard() noexcept { --realtimeGuardDepth; }
+
+bool ScopedRealtimeAllocationGuard::isActive() noexcept { return realtimeGuardDepth > 0; }
+
+ScopedRealtimeAllocationPermission::ScopedRealtimeAllocationPermission() noexcept
+    : savedDepth(realtimeGuardDepth)
+{
+    realtimeGuardDepth = 0;
+}
+
+ScopedRealtimeAllocationPermission::~ScopedRealtimeAllocationPermission() noexcept
+{
+    realtimeGuardDepth = savedDepth;
+}
+
+//==============================================================================
+// Global allocation hooks. These only forward to malloc/free, so the behaviour is
+// unchanged apart from the check. Note that juce::HeapBlock calls malloc directly
+// and is therefore not intercepted here.
+void* operator new(std::size_t size) { return allocateChecked(size); }
+void* operator new[](std::size_t size) { return allocateChecked(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    checkAllocationIsAllowed();
+    return std::malloc(size != 0 ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    checkAllocationIsAllowed();
+    return std::malloc(size != 0 ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept { freeChecked(ptr); }
+void operator delete[](void* ptr) noexcept { freeChecked(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { freeChecked(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { freeChecked(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { freeChecked(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { freeChecked(ptr); }
+
+#else
+
+bool ScopedRealtimeAllocationGuard::isActive() noexcept { return false; }
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Set NEWVERB_ALLOCATION_GUARD=1 in the project's preprocessor definitions to
+// force the guard on in release builds, or 0 to turn it off in debug builds.
+#ifndef NEWVERB_ALLOCATION_GUARD
+ #define NEWVERB_ALLOCATION_GUARD JUCE_DEBUG
+#endif
+
+//==============================================================================
+/**
+ * ScopedRealtimeAllocationGuard
+ * Marks the current thread as running real-time audio code for the lifetime of
+ * the object. When NEWVERB_ALLOCATION_GUARD is enabled, any global operator new
+ * or delete made while a guard is alive hits an assertion, which catches
+ * std::vector, juce::String, std::function and friends sneaking onto the audio
+ * thread. Guards nest, and compile away to nothing when the guard is disabled.
+ */
+class ScopedRealtimeAllocationGuard
+{
+public:
+#if NEWVERB_ALLOCATION_GUARD
+    ScopedRealtimeAllocationGuard() noexcept;
+    ~ScopedRealtimeAllocationGuard() noexcept;
+#else
+    ScopedRealtimeAllocationGuard() noexcept {}
+#endif
+
+    // True if the calling thread is currently inside a guard
+    static bool isActive() noexcept;
+
+private:
+    JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeAllocationGuard)
+};
+
+//==============================================================================
+/**
+ * ScopedRealtimeAllocationPermission
+ * Temporarily lifts an enclosing guard, for the rare audio-thread code path that
+ * is known to allocate and has been accepted as such.
+ */
+class ScopedRealtimeAllocationPermission
+{
+public:
+#if NEWVERB_ALLOCATION_GUARD
+    ScopedRealtimeAllocationPermission() noexcept;
+    ~ScopedRealtimeAllocationPermission() noexcept;
+
+private:
+    int savedDepth = 0;
+#else
+    ScopedRealtimeAllocationPermission() noexcept {}
+#endif
+
+    JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeAllocationPermission)
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * SampleConversion
+ * The few juce::FloatVectorOperations the float and double processing paths
+ * share, extended to mixed sample types. When both types match these forward
+ * to FloatVectorOperations; otherwise they are plain loops the compiler can
+ * vectorise, used where the float-only parts (the convolver, the analyser)
+ * meet the double path.
+ */
+struct SampleConversion
+{
+    // dest[i] = source[i]
+    template <typename DestType, typename SourceType>
+    static void copy(DestType* dest, const SourceType* source, int num) noexcept
+    {
+        if constexpr (std::is_same_v<DestType, SourceType>)
+        {
+            juce::FloatVectorOperations::copy(dest, source, num);
+        }
+        else
+        {
+            for (int i = 0; i < num; ++i)
+                dest[i] = static_cast<DestType>(source[i]);
+        }
+    }
+
+    // dest[i] += source[i] * multiplier
+    template <typename DestType, typename SourceType>
+    static void addWithMultiply(DestType* dest, const SourceType* source, DestType multiplier, int num) noexcept
+    {
+        if constexpr (std::is_same_v<DestType, SourceType>)
+        {
+            juce::FloatVectorOperations::addWithMultiply(dest, source, multiplier, num);
+        }
+        else
+        {
+            for (int i = 0; i < num; ++i)
+                dest[i] += static_cast<DestType>(source[i]) * multiplier;
+        }
+    }
+
+    // dest[i] += source[i] * a multiplier moving linearly from startMultiplier
+    // towards endMultiplier, as juce::AudioBuffer::addFromWithRamp() does
+    template <typename DestType, typename SourceType>
+    static void addWithMultiplyRamp(DestType* dest, const SourceType* source, DestType startMultiplier,
+                                    DestType endMultiplier, int num) noexcept
+    {
+        if (startMultiplier == endMultiplier)
+        {
+            addWithMultiply(dest, source, startMultiplier, num);
+            return;
+        }
+
+        const auto increment = (endMultiplier - startMultiplier) / static_cast<DestType>(num);
+        auto multiplier = startMultiplier;
+
+        for (int i = 0; i < num; ++i)
+        {
+            dest[i] += static_cast<DestType>(source[i]) * multiplier;
+            multiplier += increment;
+        }
+    }
+
+    // dest[i] *= multipliers[i]
+    template <typename DestType, typename MultiplierType>
+    static void multiply(DestType* dest, const MultiplierType* multipliers, int num) noexcept
+    {
+        if constexpr (std::is_same_v<DestType, MultiplierType>)
+        {
+            juce::FloatVectorOperations::multiply(dest, multipliers, num);
+        }
+        else
+        {
+            for (int i = 0; i < num; ++i)
+                dest[i] *= static_cast<DestType>(multipliers[i]);
+        }
+    }
+};
@@ -0,0 +1,324 @@
+﻿#include "SpectralKernels.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+// MSVC exposes every intrinsic unconditionally; GCC and Clang need each
+// function marked with the instruction set it is allowed to use
+#if JUCE_MSVC
+ #define NEWVERB_TARGET(isa)
+#else
+ #define NEWVERB_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace
+{
+    //==============================================================================
+    struct ScalarOps
+    {
+        using Vec = float;
+        using Int = int;
+        using Mask = bool;
+        static constexpr int width = 1;
+
+        static Vec load(const float* p) noexcept               { return *p; }
+        static void store(float* p, Vec v) noexcept            { *p = v; }
+        static Vec set(float x) noexcept                       { return x; }
+        static Vec add(Vec a, Vec b) noexcept                  { return a + b; }
+        static Vec sub(Vec a, Vec b) noexcept                  { return a - b; }
+        static Vec mul(Vec a, Vec b) noexcept                  { return a * b; }
+        static Vec div(Vec a, Vec b) noexcept                  { return a / b; }
+        static Vec muladd(Vec a, Vec b, Vec c) noexcept        { return a * b + c; }
+        static Vec sqrt(Vec a) noexcept                        { return std::sqrt(a); }
+        static Vec abs(Vec a) noexcept                         { return std::abs(a); }
+        static Vec min(Vec a, Vec b) noexcept                  { return a < b ? a : b; }
+        static Vec max(Vec a, Vec b) noexcept                  { return a > b ? a : b; }
+        static Mask less(Vec a, Vec b) noexcept                { return a < b; }
+        static Vec select(Mask m, Vec a, Vec b) noexcept       { return m ? a : b; }
+        static Int roundToInt(Vec a) noexcept                  { return (int) std::nearbyint(a); }
+        static Int addInt(Int a, int b) noexcept               { return a + b; }
+        static Vec toFloat(Int a) noexcept                     { return (float) a; }
+        static Mask hasBit(Int a, int bit) noexcept            { return (a & bit) != 0; }
+    };
+
+   #if JUCE_INTEL
+    //==============================================================================
+    #define NEWVERB_SSE2 NEWVERB_TARGET("sse2")
+
+    struct Sse2Ops
+    {
+        using Vec = __m128;
+        using Int = __m128i;
+        using Mask = __m128;
+        static constexpr int width = 4;
+
+        NEWVERB_SSE2 static Vec load(const float* p) noexcept           { return _mm_loadu_ps(p); }
+        NEWVERB_SSE2 static void store(float* p, Vec v) noexcept        { _mm_storeu_ps(p, v); }
+        NEWVERB_SSE2 static Vec set(float x) noexcept                   { return _mm_set1_ps(x); }
+        NEWVERB_SSE2 static Vec add(Vec a, Vec b) noexcept              { return _mm_add_ps(a, b); }
+        NEWVERB_SSE2 static Vec sub(Vec a, Vec b) noexcept              { return _mm_sub_ps(a, b); }
+        NEWVERB_SSE2 static Vec mul(Vec a, Vec b) noexcept              { return _mm_mul_ps(a, b); }
+        NEWVERB_SSE2 static Vec div(Vec a, Vec b) noexcept              { return _mm_div_ps(a, b); }
+        NEWVERB_SSE2 static Vec muladd(Vec a, Vec b, Vec c) noexcept    { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        NEWVERB_SSE2 static Vec sqrt(Vec a) noexcept                    { return _mm_sqrt_ps(a); }
+        NEWVERB_SSE2 static Vec abs(Vec a) noexcept                     { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+        NEWVERB_SSE2 static Vec min(Vec a, Vec b) noexcept              { return _mm_min_ps(a, b); }
+        NEWVERB_SSE2 static Vec max(Vec a, Vec b) noexcept              { return _mm_max_ps(a, b); }
+        NEWVERB_SSE2 static Mask less(Vec a, Vec b) noexcept            { return _mm_cmplt_ps(a, b); }
+        NEWVERB_SSE2 static Vec select(Mask m, Vec a, Vec b) noexcept   { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+        NEWVERB_SSE2 static Int roundToInt(Vec a) noexcept              { return _mm_cvtps_epi32(a); }
+        NEWVERB_SSE2 static Int addInt(Int a, int b) noexcept           { return _mm_add_epi32(a, _mm_set1_epi32(b)); }
+        NEWVERB_SSE2 static Vec toFloat(Int a) noexcept                 { return _mm_cvtepi32_ps(a); }
+
+        NEWVERB_SSE2 static Mask hasBit(Int a, int bit) noexcept
+        {
+            const Int b = _mm_set1_epi32(bit);
+            return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(a, b), b));
+        }
+    };
+
+    //==============================================================================
+    #define NEWVERB_AVX2 NEWVERB_TARGET("avx2,fma")
+
+    struct Avx2Ops
+    {
+        using Vec = __m256;
+        using Int = __m256i;
+        using Mask = __m256;
+        static constexpr int width = 8;
+
+        NEWVERB_AVX2 static Vec load(const float* p) noexcept           { return _mm256_loadu_ps(p); }
+        NEWVERB_AVX2 static void store(float* p, Vec v) noexcept        { _mm256_storeu_ps(p, v); }
+        NEWVERB_AVX2 static Vec set(float x) noexcept                   { return _mm256_set1_ps(x); }
+        NEWVERB_AVX2 static Vec add(Vec a, Vec b) noexcept              { return _mm256_add_ps(a, b); }
+        NEWVERB_AVX2 static Vec sub(Vec a, Vec b) noexcept              { return _mm256_sub_ps(a, b); }
+        NEWVERB_AVX2 static Vec mul(Vec a, Vec b) noexcept              { return _mm256_mul_ps(a, b); }
+        NEWVERB_AVX2 static Vec div(Vec a, Vec b) noexcept              { return _mm256_div_ps(a, b); }
+        NEWVERB_AVX2 static Vec muladd(Vec a, Vec b, Vec c) noexcept    { return _mm256_fmadd_ps(a, b, c); }
+        NEWVERB_AVX2 static Vec sqrt(Vec a) noexcept                    { return _mm256_sqrt_ps(a); }
+        NEWVERB_AVX2 static Vec abs(Vec a) noexcept                     { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+        NEWVERB_AVX2 static Vec min(Vec a, Vec b) noexcept              { return _mm256_min_ps(a, b); }
+        NEWVERB_AVX2 static Vec max(Vec a, Vec b) noexcept              { return _mm256_max_ps(a, b); }
+        NEWVERB_AVX2 static Mask less(Vec a, Vec b) noexcept            { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        NEWVERB_AVX2 static Vec select(Mask m, Vec a, Vec b) noexcept   { return _mm256_blendv_ps(b, a, m); }
+        NEWVERB_AVX2 static Int roundToInt(Vec a) noexcept              { return _mm256_cvtps_epi32(a); }
+        NEWVERB_AVX2 static Int addInt(Int a, int b) noexcept           { return _mm256_add_epi32(a, _mm256_set1_epi32(b)); }
+        NEWVERB_AVX2 static Vec toFloat(Int a) noexcept                 { return _mm256_cvtepi32_ps(a); }
+
+        NEWVERB_AVX2 static Mask hasBit(Int a, int bit) noexcept
+        {
+            const Int b = _mm256_set1_epi32(bit);
+            return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(a, b), b));
+        }
+    };
+
+    //==============================================================================
+    #define NEWVERB_AVX512 NEWVERB_TARGET("avx512f")
+
+    struct Avx512Ops
+    {
+        using Vec = __m512;
+        using Int = __m512i;
+        using Mask = __mmask16;
+        static constexpr int width = 16;
+
+        NEWVERB_AVX512 static Vec load(const float* p) noexcept         { return _mm512_loadu_ps(p); }
+        NEWVERB_AVX512 static void store(float* p, Vec v) noexcept      { _mm512_storeu_ps(p, v); }
+        NEWVERB_AVX512 static Vec set(float x) noexcept                 { return _mm512_set1_ps(x); }
+        NEWVERB_AVX512 static Vec add(Vec a, Vec b) noexcept            { return _mm512_add_ps(a, b); }
+        NEWVERB_AVX512 static Vec sub(Vec a, Vec b) noexcept            { return _mm512_sub_ps(a, b); }
+        NEWVERB_AVX512 static Vec mul(Vec a, Vec b) noexcept            { return _mm512_mul_ps(a, b); }
+        NEWVERB_AVX512 static Vec div(Vec a, Vec b) noexcept            { return _mm512_div_ps(a, b); }
+        NEWVERB_AVX512 static Vec muladd(Vec a, Vec b, Vec c) noexcept  { return _mm512_fmadd_ps(a, b, c); }
+        NEWVERB_AVX512 static Vec sqrt(Vec a) noexcept                  { return _mm512_sqrt_ps(a); }
+        NEWVERB_AVX512 static Vec min(Vec a, Vec b) noexcept            { return _mm512_min_ps(a, b); }
+        NEWVERB_AVX512 static Vec max(Vec a, Vec b) noexcept            { return _mm512_max_ps(a, b); }
+        NEWVERB_AVX512 static Mask less(Vec a, Vec b) noexcept          { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+        NEWVERB_AVX512 static Vec select(Mask m, Vec a, Vec b) noexcept { return _mm512_mask_blend_ps(m, b, a); }
+        NEWVERB_AVX512 static Int roundToInt(Vec a) noexcept            { return _mm512_cvtps_epi32(a); }
+        NEWVERB_AVX512 static Int addInt(Int a, int b) noexcept         { return _mm512_add_epi32(a, _mm512_set1_epi32(b)); }
+        NEWVERB_AVX512 static Vec toFloat(Int a) noexcept               { return _mm512_cvtepi32_ps(a); }
+        NEWVERB_AVX512 static Mask hasBit(Int a, int bit) noexcept      { return _mm512_test_epi32_mask(a, _mm512_set1_epi32(bit)); }
+
+        // AVX-512F has no float and-not, so clear the sign bit as an integer
+        NEWVERB_AVX512 static Vec abs(Vec a) noexcept
+        {
+            return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+        }
+    };
+   #endif
+}
+
+//==============================================================================
+#define NEWVERB_KERNEL_NAMESPACE scalarKernels
+#define NEWVERB_KERNEL_OPS ScalarOps
+#define NEWVERB_KERNEL_TARGET
+#include "SpectralKernelsImpl.h"
+#undef NEWVERB_KERNEL_NAMESPACE
+#undef NEWVERB_KERNEL_OPS
+#undef NEWVERB_KERNEL_TARGET
+
+#if JUCE_INTEL
+ #define NEWVERB_KERNEL_NAMESPACE sse2Kernels
+ #define NEWVERB_KERNEL_OPS Sse2Ops
+ #define NEWVERB_KERNEL_TARGET NEWVERB_SSE2
+ #include "SpectralKernelsImpl.h"
+ #undef NEWVERB_KERNEL_NAMESPACE
+ #undef NEWVERB_KERNEL_OPS
+ #undef NEWVERB_KERNEL_TARGET
+
+ #define NEWVERB_KERNEL_NAMESPACE avx2Kernels
+ #define NEWVERB_KERNEL_OPS Avx2Ops
+ #define NEWVERB_KERNEL_TARGET NEWVERB_AVX2
+ #include "SpectralKernelsImpl.h"
+ #undef NEWVERB_KERNEL_NAMESPACE
+ #undef NEWVERB_KERNEL_OPS
+ #undef NEWVERB_KERNEL_TARGET
+
+ // GCC flags the deliberately undefined pass-through operands inside its own AVX-512 headers
+ JUCE_BEGIN_IGNORE_WARNINGS_GCC_LIKE ("-Wmaybe-uninitialized")
+ #define NEWVERB_KERNEL_NAMESPACE avx512Kernels
+ #define NEWVERB_KERNEL_OPS Avx512Ops
+ #define NEWVERB_KERNEL_TARGET NEWVERB_AVX512
+ #include "SpectralKernelsImpl.h"
+ #undef NEWVERB_KERNEL_NAMESPACE
+ #undef NEWVERB_KERNEL_OPS
+ #undef NEWVERB_KERNEL_TARGET
+ JUCE_END_IGNORE_WARNINGS_GCC_LIKE
+#endif
+
+namespace
+{
+    //==============================================================================
+    struct KernelTable
+    {
+        SpectralKernels::InstructionSet instructionSet;
+        int (*magnitude)(const float*, const float*, float*, int) noexcept;
+        int (*phase)(const float*, const float*, float*, int) noexcept;
+        int (*cartesianToPolar)(const float*, const float*, float*, float*, int) noexcept;
+        int (*polarToCartesian)(const float*, const float*, float*, float*, int) noexcept;
+        int (*complexMultiply)(const float*, const float*, const float*, const float*, float*, float*, int) noexcept;
+        int (*complexMultiplyAccumulate)(const float*, const float*, const float*, const float*, float*, float*, int) noexcept;
+    };
+
+    #define NEWVERB_KERNEL_TABLE(set, ns) \
+        { SpectralKernels::InstructionSet::set, ns::magnitude, ns::phase, ns::cartesianToPolar, \
+          ns::polarToCartesian, ns::complexMultiply, ns::complexMultiplyAccumulate }
+
+    const KernelTable scalarTable = NEWVERB_KERNEL_TABLE(scalar, scalarKernels);
+
+   #if JUCE_INTEL
+    const KernelTable sse2Table = NEWVERB_KERNEL_TABLE(sse2, sse2Kernels);
+    const KernelTable avx2Table = NEWVERB_KERNEL_TABLE(avx2, avx2Kernels);
+    const KernelTable avx512Table = NEWVERB_KERNEL_TABLE(avx512, avx512Kernels);
+   #endif
+
+    #undef NEWVERB_KERNEL_TABLE
+
+    const KernelTable& getTableFor(SpectralKernels::InstructionSet set) noexcept
+    {
+        switch (set)
+        {
+           #if JUCE_INTEL
+            case SpectralKernels::InstructionSet::avx512:  return avx512Table;
+            case SpectralKernels::InstructionSet::avx2:    return avx2Table;
+            case SpectralKernels::InstructionSet::sse2:    return sse2Table;
+           #endif
+            default:                                        return scalarTable;
+        }
+    }
+
+    std::atomic<const KernelTable*> activeTable { nullptr };
+
+    const KernelTable& getActiveTable() noexcept
+    {
+        // Resolved on first use; racing threads all arrive at the same answer
+        if (auto* table = activeTable.load(std::memory_order_acquire))
+            return *table;
+
+        auto& best = getTableFor(SpectralKernels::getBestSupportedInstructionSet());
+        activeTable.store(&best, std::memory_order_release);
+        return best;
+    }
+}
+
+//==============================================================================
+SpectralKernels::InstructionSet SpectralKernels::getBestSupportedInstructionSet() noexcept
+{
+   #if JUCE_INTEL
+    if (juce::SystemStats::hasAVX512F())
+        return InstructionSet::avx512;
+
+    if (juce::SystemStats::hasAVX2() && juce::SystemStats::hasFMA3())
+        return InstructionSet::avx2;
+
+    if (juce::SystemStats::hasSSE2())
+        return InstructionSet::sse2;
+   #endif
+
+    return InstructionSet::scalar;
+}
+
+SpectralKernels::InstructionSet SpectralKernels::getInstructionSet() noexcept
+{
+    return getActiveTable().instructionSet;
+}
+
+void SpectralKernels::setInstructionSet(InstructionSet set) noexcept
+{
+    const auto best = getBestSupportedInstructionSet();
+    activeTable.store(&getTableFor((int) set <= (int) best ? set : best), std::memory_order_release);
+}
+
+const char* SpectralKernels::getInstructionSetName(InstructionSet set) noexcept
+{
+    switch (set)
+    {
+        case InstructionSet::avx512:    return "AVX-512";
+        case InstructionSet::avx2:      return "AVX2";
+        case InstructionSet::sse2:      return "SSE2";
+        case InstructionSet::scalar:    break;
+    }
+
+    return "Scalar";
+}
+
+//==============================================================================
+void SpectralKernels::magnitude(const float* real, const float* imag, float* dest, int num) noexcept
+{
+    const int done = getActiveTable().magnitude(real, imag, dest, num);
+    scalarKernels::magnitude(real + done, imag + done, dest + done, num - done);
+}
+
+void SpectralKernels::phase(const float* real, const float* imag, float* dest, int num) noexcept
+{
+    const int done = getActiveTable().phase(real, imag, dest, num);
+    scalarKernels::phase(real + done, imag + done, dest + done, num - done);
+}
+
+void SpectralKernels::cartesianToPolar(const float* real, const float* imag, float* magnitudes, float* phases, int num) noexcept
+{
+    const int done = getActiveTable().cartesianToPolar(real, imag, magnitudes, phases, num);
+    scalarKernels::cartesianToPolar(real + done, imag + done, magnitudes + done, phases + done, num - done);
+}
+
+void SpectralKernels::polarToCartesian(const float* magnitudes, const float* phases, float* real, float* imag, int num) noexcept
+{
+    const int done = getActiveTable().polarToCartesian(magnitudes, phases, real, imag, num);
+    scalarKernels::polarToCartesian(magnitudes + done, phases + done, real + done, imag + done, num - done);
+}
+
+void SpectralKernels::complexMultiply(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                                      float* destReal, float* destImag, int num) noexcept
+{
+    const int done = getActiveTable().complexMultiply(aReal, aImag, bReal, bImag, destReal, destImag, num);
+    scalarKernels::complexMultiply(aReal + done, aImag + done, bReal + done, bImag + done, destReal + done, destImag + done, num - done);
+}
+
+void SpectralKernels::complexMultiplyAccumulate(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                                                float* destReal, float* destImag, int num) noexcept
+{
+    const int done = getActiveTable().complexMultiplyAccumulate(aReal, aImag, bReal, bImag, destReal, destImag, num);
+    scalarKernels::complexMultiplyAccumulate(aReal + done, aImag + done, bReal + done, bImag + done, destReal + done, destImag + done, num - done);
+}
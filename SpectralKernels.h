@@ -0,0 +1,59 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * SpectralKernels
+ * Vectorised loops over split (real/imaginary) spectra, in the spirit of
+ * juce::FloatVectorOperations.
+ *
+ * Every kernel has a scalar reference and SSE2, AVX2 and AVX-512 versions. The
+ * fastest version the CPU supports is picked the first time a kernel runs, so
+ * one binary uses the best path on every machine. Phase and trigonometry use
+ * polynomial approximations: measured on every instruction set, phase() is
+ * within 2e-6 radians of atan2, and polarToCartesian()'s sin and cos are
+ * within 1e-7 for phases up to 8 pi either side of zero.
+ */
+struct SpectralKernels
+{
+    //==============================================================================
+    enum class InstructionSet
+    {
+        scalar,
+        sse2,
+        avx2,
+        avx512
+    };
+
+    // The instruction set the kernels currently run with
+    static InstructionSet getInstructionSet() noexcept;
+
+    // Forces a particular implementation, e.g. to compare them against each other.
+    // Falls back to the best supported one if the CPU lacks the requested set.
+    static void setInstructionSet(InstructionSet set) noexcept;
+
+    static InstructionSet getBestSupportedInstructionSet() noexcept;
+    static const char* getInstructionSetName(InstructionSet set) noexcept;
+
+    //==============================================================================
+    // dest[i] = |real[i] + j imag[i]|
+    static void magnitude(const float* real, const float* imag, float* dest, int num) noexcept;
+
+    // dest[i] = atan2(imag[i], real[i])
+    static void phase(const float* real, const float* imag, float* dest, int num) noexcept;
+
+    // Both of the above in one pass
+    static void cartesianToPolar(const float* real, const float* imag, float* magnitudes, float* phases, int num) noexcept;
+
+    // real[i] = magnitudes[i] cos(phases[i]), imag[i] = magnitudes[i] sin(phases[i])
+    static void polarToCartesian(const float* magnitudes, const float* phases, float* real, float* imag, int num) noexcept;
+
+    // dest = a * b, element-wise complex. dest may alias a or b.
+    static void complexMultiply(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                                float* destReal, float* destImag, int num) noexcept;
+
+    // dest += a * b, element-wise complex
+    static void complexMultiplyAccumulate(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                                          float* destReal, float* destImag, int num) noexcept;
+};
@@ -0,0 +1,158 @@
+// Kernel bodies shared by every instruction set. SpectralKernels.cpp includes
+// this file once per implementation, after defining:
+//   NEWVERB_KERNEL_NAMESPACE   the namespace the kernels go into
+//   NEWVERB_KERNEL_OPS         the vector operations type to build them from
+//   NEWVERB_KERNEL_TARGET      the matching function target attribute
+// Each kernel returns how many elements it handled; the caller finishes the
+// remainder with the scalar version.
+
+namespace NEWVERB_KERNEL_NAMESPACE
+{
+    using Ops = NEWVERB_KERNEL_OPS;
+    using Vec = Ops::Vec;
+
+    //==============================================================================
+    NEWVERB_KERNEL_TARGET static inline Vec negateWhere(Ops::Mask mask, Vec value) noexcept
+    {
+        return Ops::select(mask, Ops::sub(Ops::set(0.0f), value), value);
+    }
+
+    // atan2 via a minimax polynomial for atan on [0, 1] and octant folding
+    NEWVERB_KERNEL_TARGET static inline Vec fastAtan2(Vec y, Vec x) noexcept
+    {
+        const Vec ax = Ops::abs(x);
+        const Vec ay = Ops::abs(y);
+        const Vec a = Ops::div(Ops::min(ax, ay), Ops::max(Ops::max(ax, ay), Ops::set(1.0e-30f)));
+        const Vec s = Ops::mul(a, a);
+
+        Vec p = Ops::set(-0.01172120f);
+        p = Ops::muladd(p, s, Ops::set(0.05265332f));
+        p = Ops::muladd(p, s, Ops::set(-0.11643287f));
+        p = Ops::muladd(p, s, Ops::set(0.19354346f));
+        p = Ops::muladd(p, s, Ops::set(-0.33262347f));
+        p = Ops::muladd(p, s, Ops::set(0.99997726f));
+        p = Ops::mul(p, a);
+
+        p = Ops::select(Ops::less(ax, ay), Ops::sub(Ops::set(juce::MathConstants<float>::halfPi), p), p);
+        p = Ops::select(Ops::less(x, Ops::set(0.0f)), Ops::sub(Ops::set(juce::MathConstants<float>::pi), p), p);
+        return negateWhere(Ops::less(y, Ops::set(0.0f)), p);
+    }
+
+    // sin and cos together: reduce to [-pi/4, pi/4] around the nearest quarter
+    // turn, evaluate both polynomials and swap/negate by quadrant
+    NEWVERB_KERNEL_TARGET static inline void fastSinCos(Vec x, Vec& sinOut, Vec& cosOut) noexcept
+    {
+        const auto quadrant = Ops::roundToInt(Ops::mul(x, Ops::set(0.636619772f)));
+        const Vec q = Ops::toFloat(quadrant);
+
+        // Three-part pi/2 keeps the reduction exact for the phases we see
+        Vec r = Ops::muladd(q, Ops::set(-1.5703125f), x);
+        r = Ops::muladd(q, Ops::set(-4.837512969970703125e-4f), r);
+        r = Ops::muladd(q, Ops::set(-7.54978995489188216e-8f), r);
+
+        const Vec z = Ops::mul(r, r);
+
+        Vec sinR = Ops::muladd(Ops::set(-1.9515295891e-4f), z, Ops::set(8.3321608736e-3f));
+        sinR = Ops::muladd(sinR, z, Ops::set(-1.6666654611e-1f));
+        sinR = Ops::muladd(Ops::mul(sinR, z), r, r);
+
+        Vec cosR = Ops::muladd(Ops::set(2.443315711809948e-5f), z, Ops::set(-1.388731625493765e-3f));
+        cosR = Ops::muladd(cosR, z, Ops::set(4.166664568298827e-2f));
+        cosR = Ops::muladd(Ops::mul(cosR, z), z, Ops::muladd(Ops::set(-0.5f), z, Ops::set(1.0f)));
+
+        const auto swap = Ops::hasBit(quadrant, 1);
+        sinOut = negateWhere(Ops::hasBit(quadrant, 2), Ops::select(swap, cosR, sinR));
+        cosOut = negateWhere(Ops::hasBit(Ops::addInt(quadrant, 1), 2), Ops::select(swap, sinR, cosR));
+    }
+
+    //==============================================================================
+    NEWVERB_KERNEL_TARGET static int magnitude(const float* real, const float* imag, float* dest, int num) noexcept
+    {
+        int i = 0;
+
+        for (; i + Ops::width <= num; i += Ops::width)
+        {
+            const Vec re = Ops::load(real + i);
+            const Vec im = Ops::load(imag + i);
+            Ops::store(dest + i, Ops::sqrt(Ops::muladd(re, re, Ops::mul(im, im))));
+        }
+
+        return i;
+    }
+
+    NEWVERB_KERNEL_TARGET static int phase(const float* real, const float* imag, float* dest, int num) noexcept
+    {
+        int i = 0;
+
+        for (; i + Ops::width <= num; i += Ops::width)
+            Ops::store(dest + i, fastAtan2(Ops::load(imag + i), Ops::load(real + i)));
+
+        return i;
+    }
+
+    NEWVERB_KERNEL_TARGET static int cartesianToPolar(const float* real, const float* imag, float* magnitudes, float* phases, int num) noexcept
+    {
+        int i = 0;
+
+        for (; i + Ops::width <= num; i += Ops::width)
+        {
+            const Vec re = Ops::load(real + i);
+            const Vec im = Ops::load(imag + i);
+            Ops::store(magnitudes + i, Ops::sqrt(Ops::muladd(re, re, Ops::mul(im, im))));
+            Ops::store(phases + i, fastAtan2(im, re));
+        }
+
+        return i;
+    }
+
+    NEWVERB_KERNEL_TARGET static int polarToCartesian(const float* magnitudes, const float* phases, float* real, float* imag, int num) noexcept
+    {
+        int i = 0;
+
+        for (; i + Ops::width <= num; i += Ops::width)
+        {
+            Vec s, c;
+            fastSinCos(Ops::load(phases + i), s, c);
+
+            const Vec m = Ops::load(magnitudes + i);
+            Ops::store(real + i, Ops::mul(m, c));
+            Ops::store(imag + i, Ops::mul(m, s));
+        }
+
+        return i;
+    }
+
+    NEWVERB_KERNEL_TARGET static int complexMultiply(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                                                     float* destReal, float* destImag, int num) noexcept
+    {
+        int i = 0;
+
+        for (; i + Ops::width <= num; i += Ops::width)
+        {
+            const Vec ar = Ops::load(aReal + i), ai = Ops::load(aImag + i);
+            const Vec br = Ops::load(bReal + i), bi = Ops::load(bImag + i);
+
+            Ops::store(destReal + i, Ops::sub(Ops::mul(ar, br), Ops::mul(ai, bi)));
+            Ops::store(destImag + i, Ops::muladd(ar, bi, Ops::mul(ai, br)));
+        }
+
+        return i;
+    }
+
+    NEWVERB_KERNEL_TARGET static int complexMultiplyAccumulate(const float* aReal, const float* aImag, const float* bReal, const float* bImag,
+                                                               float* destReal, float* destImag, int num) noexcept
+    {
+        int i = 0;
+
+        for (; i + Ops::width <= num; i += Ops::width)
+        {
+            const Vec ar = Ops::load(aReal + i), ai = Ops::load(aImag + i);
+            const Vec br = Ops::load(bReal + i), bi = Ops::load(bImag + i);
+
+            Ops::store(destReal + i, Ops::add(Ops::load(destReal + i), Ops::sub(Ops::mul(ar, br), Ops::mul(ai, bi))));
+            Ops::store(destImag + i, Ops::add(Ops::load(destImag + i), Ops::muladd(ar, bi, Ops::mul(ai, br))));
+        }
+
+        return i;
+    }
+}
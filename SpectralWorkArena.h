@@ -0,0 +1,73 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * SpectralWorkArena
+ * A single block of scratch memory that is sized once, outside the audio thread,
+ * and then carved into aligned spans. Taking a span never allocates, so the
+ * processor can hand out all of its working buffers from here in prepareToPlay
+ * and use them freely from processBlock.
+ */
+class SpectralWorkArena
+{
+public:
+    SpectralWorkArena() = default;
+
+    // Every span handed out starts on a cache line boundary
+    static constexpr size_t alignment = 64;
+
+    // Number of bytes a span of numElements will consume, including padding
+    template <typename ElementType>
+    static constexpr size_t bytesFor(size_t numElements) noexcept
+    {
+        return ((numElements * sizeof(ElementType)) + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Reserves (and zeroes) the given number of bytes. Must not be called on the audio thread.
+    void allocate(size_t numBytes)
+    {
+        storage.calloc(numBytes + alignment);
+
+        const auto address = reinterpret_cast<uintptr_t>(storage.get());
+        alignedStart = storage.get() + (((address + alignment - 1) & ~(uintptr_t)(alignment - 1)) - address);
+        capacity = numBytes;
+        used = 0;
+    }
+
+    void release()
+    {
+        storage.free();
+        alignedStart = nullptr;
+        capacity = 0;
+        used = 0;
+    }
+
+    // Hands out the next numElements-sized span. Spans stay valid until allocate() or release().
+    template <typename ElementType>
+    ElementType* take(size_t numElements) noexcept
+    {
+        const auto numBytes = bytesFor<ElementType>(numElements);
+
+        // The arena was sized too small in prepareToPlay
+        jassert(used + numBytes <= capacity);
+        if (used + numBytes > capacity)
+            return nullptr;
+
+        auto* span = reinterpret_cast<ElementType*>(alignedStart + used);
+        used += numBytes;
+        return span;
+    }
+
+    size_t getCapacity() const noexcept { return capacity; }
+    size_t getBytesUsed() const noexcept { return used; }
+
+private:
+    juce::HeapBlock<char> storage;
+    char* alignedStart = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectralWorkArena)
+};
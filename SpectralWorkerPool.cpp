@@ -0,0 +1,123 @@
+﻿#include "SpectralWorkerPool.h"
+#include "RealtimeGuard.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+
+//==============================================================================
+class SpectralWorkerPool::Worker : public juce::Thread
+{
+public:
+    Worker(SpectralWorkerPool& p, int index)
+        : juce::Thread("Spectral worker " + juce::String(index)), pool(p)
+    {
+    }
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            wait(-1);
+
+            if (threadShouldExit())
+                break;
+
+            // Workers are held to the same rules as the audio thread they help
+            juce::ScopedNoDenormals noDenormals;
+            ScopedRealtimeAllocationGuard allocationGuard;
+            pool.runAvailableItems();
+        }
+    }
+
+private:
+    SpectralWorkerPool& pool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Worker)
+};
+
+//==============================================================================
+SpectralWorkerPool::SpectralWorkerPool(int numWorkers, int hostBlockSize, double hostSampleRate)
+    : blockSize(juce::jmax(1, hostBlockSize)), sampleRate(hostSampleRate > 0.0 ? hostSampleRate : 44100.0)
+{
+    // The same scheduling class as the audio thread, so a worker can't be
+    // preempted by ordinary threads while the audio thread waits on its item
+    const auto options = juce::Thread::RealtimeOptions{}.withApproximateAudioProcessingTime(blockSize, sampleRate);
+
+    for (int i = 0; i < numWorkers; ++i)
+    {
+        auto* worker = workers.add(new Worker(*this, i));
+
+        if (!worker->startRealtimeThread(options))
+            worker->startThread(juce::Thread::Priority::highest);
+    }
+}
+
+SpectralWorkerPool::~SpectralWorkerPool()
+{
+    for (auto* worker : workers)
+        worker->signalThreadShouldExit();
+
+    for (auto* worker : workers)
+    {
+        worker->notify();
+        worker->stopThread(1000);
+    }
+}
+
+int SpectralWorkerPool::getDefaultNumWorkers(int numItems) noexcept
+{
+    // The audio thread takes one share itself, and we stay well clear of
+    // the host's own audio threads
+    return juce::jlimit(0, 3, juce::jmin(numItems - 1, juce::SystemStats::getNumCpus() / 2));
+}
+
+//==============================================================================
+void SpectralWorkerPool::run(Job& job, int numItems) noexcept
+{
+    if (numItems <= 0)
+        return;
+
+    jassert(numItems <= maxItemsPerRound);
+    numItems = juce::jmin(numItems, maxItemsPerRound);
+
+    // Open a new round. Publishing nextItem last makes the job visible to any
+    // worker that manages to claim an item.
+    currentJob.store(&job, std::memory_order_relaxed);
+    itemsRemaining.store(numItems, std::memory_order_relaxed);
+    nextItem.store(makeRound(++roundTag, numItems), std::memory_order_release);
+
+    for (int i = 0; i < juce::jmin(workers.size(), numItems - 1); ++i)
+        workers.getUnchecked(i)->notify();
+
+    runAvailableItems();
+
+    // Whatever is left has already been claimed by a running worker
+    while (itemsRemaining.load(std::memory_order_acquire) > 0)
+    {
+       #if JUCE_INTEL
+        _mm_pause();
+       #endif
+    }
+
+    // Close the round: a worker that claims only now sees a count of zero
+    nextItem.store(makeRound(roundTag, 0), std::memory_order_relaxed);
+}
+
+void SpectralWorkerPool::runAvailableItems() noexcept
+{
+    for (;;)
+    {
+        const auto claim = nextItem.fetch_add(1, std::memory_order_acq_rel);
+        const auto index = (juce::uint32) claim;
+        const auto numItems = (juce::uint32) ((claim >> countShift) & maxItemsPerRound);
+
+        // Validated against the round the claim came from. A valid claim keeps
+        // that round open until its item is done, so currentJob is still its job.
+        if (index >= numItems)
+            return;
+
+        currentJob.load(std::memory_order_relaxed)->runJobItem((int) index);
+        itemsRemaining.fetch_sub(1, std::memory_order_release);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * SpectralWorkerPool
+ * A small, fixed set of worker threads that help the audio thread get through
+ * independent pieces of work, such as the per-channel hops of an STFT.
+ *
+ * run() never allocates or takes a lock that a worker could hold for long: items
+ * are claimed through an atomic counter, the calling thread works on items too,
+ * and it only spins for the items workers have already started. Since the audio
+ * thread waits on them, the workers are real-time threads scheduled for the
+ * host's block period, falling back to the highest normal priority where the
+ * OS refuses.
+ */
+class SpectralWorkerPool
+{
+public:
+    //==============================================================================
+    struct Job
+    {
+        virtual ~Job() = default;
+
+        // Called once for every index in [0, numItems), possibly from several threads at once
+        virtual void runJobItem(int index) noexcept = 0;
+    };
+
+    //==============================================================================
+    // blockSize and sampleRate describe the host callback the workers help with
+    SpectralWorkerPool(int numWorkers, int blockSize, double sampleRate);
+    ~SpectralWorkerPool();
+
+    int getNumWorkers() const noexcept { return workers.size(); }
+    int getBlockSize() const noexcept { return blockSize; }
+    double getSampleRate() const noexcept { return sampleRate; }
+
+    // Runs every item of the job and returns once they have all finished
+    void run(Job& job, int numItems) noexcept;
+
+    // A sensible worker count for the given number of parallel items
+    static int getDefaultNumWorkers(int numItems) noexcept;
+
+private:
+    //==============================================================================
+    class Worker;
+
+    void runAvailableItems() noexcept;
+
+    // nextItem packs the round's tag (top 16 bits), its item count (next 16)
+    // and the next index to claim (low 32). A single fetch_add then yields a
+    // claim that carries its own round's count, so an index left over from
+    // one round can never be checked against the count of a later one. A
+    // closed round has a count of zero, so every claim on it fails.
+    static constexpr int tagShift = 48;
+    static constexpr int countShift = 32;
+    static constexpr int maxItemsPerRound = 0xffff;
+
+    static juce::uint64 makeRound(juce::uint32 tag, int numItems) noexcept
+    {
+        return ((juce::uint64) (tag & 0xffff) << tagShift) | ((juce::uint64) numItems << countShift);
+    }
+
+    const int blockSize;
+    const double sampleRate;
+    juce::OwnedArray<Worker> workers;
+
+    std::atomic<Job*> currentJob { nullptr };
+    std::atomic<juce::uint64> nextItem { 0 };
+    std::atomic<int> itemsRemaining { 0 };
+    juce::uint32 roundTag = 0;                  // only touched by run()
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectralWorkerPool)
+};
@@ -0,0 +1,302 @@
+﻿#include "SpectrumAnalyser.h"
+#include "SpectralKernels.h"
+#include "SampleConversion.h"
+
+namespace
+{
+    // Writes the average of the first numChannels channels of source to dest
+    template <typename SampleType>
+    void downmix(const juce::AudioBuffer<SampleType>& source, int startSample, int numChannels, float* dest, int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        const float channelGain = 1.0f / (float) numChannels;
+        juce::FloatVectorOperations::clear(dest, numSamples);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            SampleConversion::addWithMultiply(dest, source.getReadPointer(channel, startSample), channelGain, numSamples);
+    }
+}
+
+//==============================================================================
+SpectrumAnalyser::SpectrumAnalyser()
+    : juce::Thread("Spectrum analyser")
+{
+    inputFifo.calloc((size_t) fifoSize);
+    outputFifo.calloc((size_t) fifoSize);
+}
+
+SpectrumAnalyser::~SpectrumAnalyser()
+{
+    signalThreadShouldExit();
+    notify();
+    stopThread(1000);
+}
+
+void SpectrumAnalyser::prepare(double sampleRate)
+{
+    currentSampleRate.store(sampleRate);
+    settingsChanged.store(true);
+}
+
+void SpectrumAnalyser::setSettings(const Settings& newSettings)
+{
+    {
+        const juce::ScopedLock sl(settingsLock);
+        settings = newSettings;
+    }
+
+    settingsChanged.store(true);
+}
+
+SpectrumAnalyser::Settings SpectrumAnalyser::getSettings() const
+{
+    const juce::ScopedLock sl(settingsLock);
+    return settings;
+}
+
+void SpectrumAnalyser::setEnabled(bool shouldBeEnabled)
+{
+    if (enabled.exchange(shouldBeEnabled) == shouldBeEnabled || !shouldBeEnabled)
+        return;
+
+    if (isThreadRunning())
+        notify();
+    else
+        startThread(juce::Thread::Priority::low);
+}
+
+//==============================================================================
+template <typename SampleType>
+void SpectrumAnalyser::pushSamples(const juce::AudioBuffer<SampleType>& input, int inputStartSample,
+                                   const juce::AudioBuffer<SampleType>& output, int outputStartSample, int numSamples) noexcept
+{
+    const int numChannels = juce::jmin(input.getNumChannels(), output.getNumChannels());
+
+    // Drop the block whole if the analyser has fallen behind, so the two streams stay aligned
+    if (numChannels <= 0 || numSamples <= 0 || fifo.getFreeSpace() < numSamples)
+        return;
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    downmix(input, inputStartSample, numChannels, inputFifo + start1, size1);
+    downmix(input, inputStartSample + size1, numChannels, inputFifo + start2, size2);
+    downmix(output, outputStartSample, numChannels, outputFifo + start1, size1);
+    downmix(output, outputStartSample + size1, numChannels, outputFifo + start2, size2);
+
+    fifo.finishedWrite(size1 + size2);
+}
+
+template void SpectrumAnalyser::pushSamples(const juce::AudioBuffer<float>&, int, const juce::AudioBuffer<float>&, int, int) noexcept;
+template void SpectrumAnalyser::pushSamples(const juce::AudioBuffer<double>&, int, const juce::AudioBuffer<double>&, int, int) noexcept;
+
+//==============================================================================
+void SpectrumAnalyser::run()
+{
+    while (!threadShouldExit())
+    {
+        if (!isEnabled())
+        {
+            discardPendingAudio();
+            wait(-1);
+            continue;
+        }
+
+        if (settingsChanged.exchange(false))
+            configure();
+
+        drainFifo();
+        wait(pollIntervalMs);
+    }
+}
+
+void SpectrumAnalyser::discardPendingAudio()
+{
+    fifo.finishedRead(fifo.getNumReady());
+
+    // Start over from empty rings and averages when analysis resumes
+    settingsChanged.store(true);
+}
+
+void SpectrumAnalyser::configure()
+{
+    activeSettings = getSettings();
+
+    const int order = juce::jlimit(minFFTOrder, maxFFTOrder, activeSettings.fftOrder);
+    const int overlap = juce::jlimit(1, 16, (int) juce::nextPowerOfTwo(juce::jmax(1, activeSettings.overlap)));
+
+    fftSize = 1 << order;
+    hopSize = fftSize / overlap;
+    numBins = fftSize / 2 + 1;
+    fft = std::make_unique<juce::dsp::FFT>(order);
+
+    // Periodic Hann, scaled so that a full-scale sine reads 1.0 at any FFT size
+    window.resize((size_t) fftSize);
+    float windowSum = 0.0f;
+
+    for (int i = 0; i < fftSize; ++i)
+    {
+        window[(size_t) i] = 0.5f - 0.5f * std::cos(2.0f * juce::MathConstants<float>::pi * i / fftSize);
+        windowSum += window[(size_t) i];
+    }
+
+    juce::FloatVectorOperations::multiply(window.data(), 2.0f / windowSum, fftSize);
+
+    inputRing.assign((size_t) fftSize, 0.0f);
+    outputRing.assign((size_t) fftSize, 0.0f);
+    workspace.assign((size_t) fftSize * 2, 0.0f);
+    spectrumReal.assign((size_t) numBins, 0.0f);
+    spectrumImag.assign((size_t) numBins, 0.0f);
+    magnitudes.assign((size_t) numBins, 0.0f);
+    inputAverage.assign((size_t) numBins, 0.0f);
+    outputAverage.assign((size_t) numBins, 0.0f);
+    outputPeak.assign((size_t) numBins, 0.0f);
+
+    ringPosition = 0;
+    samplesUntilNextHop = hopSize;
+    streamPosition = 0;
+    hasAverage = false;
+
+    // Per-frame smoothing and decay for the configured time constants
+    const double framesPerSecond = currentSampleRate.load() / hopSize;
+
+    averagingCoefficient = activeSettings.averagingTimeSeconds > 0.0f
+        ? (float) std::exp(-1.0 / (activeSettings.averagingTimeSeconds * framesPerSecond))
+        : 0.0f;
+
+    peakDecay = juce::Decibels::decibelsToGain((float) (-activeSettings.peakDecayDbPerSecond / framesPerSecond));
+}
+
+void SpectrumAnalyser::drainFifo()
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+
+    consume(inputFifo + start1, outputFifo + start1, size1);
+    consume(inputFifo + start2, outputFifo + start2, size2);
+
+    fifo.finishedRead(size1 + size2);
+}
+
+void SpectrumAnalyser::consume(const float* input, const float* output, int numSamples)
+{
+    while (numSamples > 0)
+    {
+        // Same ring scheme as the STFT engine: spans end at the next hop boundary
+        const int spanLength = juce::jmin(numSamples, samplesUntilNextHop);
+        const int firstPart = juce::jmin(spanLength, fftSize - ringPosition);
+        const int secondPart = spanLength - firstPart;
+
+        juce::FloatVectorOperations::copy(inputRing.data() + ringPosition, input, firstPart);
+        juce::FloatVectorOperations::copy(inputRing.data(), input + firstPart, secondPart);
+        juce::FloatVectorOperations::copy(outputRing.data() + ringPosition, output, firstPart);
+        juce::FloatVectorOperations::copy(outputRing.data(), output + firstPart, secondPart);
+
+        ringPosition = (ringPosition + spanLength) & (fftSize - 1);
+        samplesUntilNextHop -= spanLength;
+        streamPosition += spanLength;
+        input += spanLength;
+        output += spanLength;
+        numSamples -= spanLength;
+
+        if (samplesUntilNextHop == 0)
+        {
+            analyseFrame();
+            samplesUntilNextHop = hopSize;
+        }
+    }
+}
+
+//==============================================================================
+void SpectrumAnalyser::measure(const std::vector<float>& ring)
+{
+    // The ring holds exactly one frame, whose oldest sample sits at ringPosition
+    const int firstPart = fftSize - ringPosition;
+
+    juce::FloatVectorOperations::multiply(workspace.data(), ring.data() + ringPosition, window.data(), firstPart);
+    juce::FloatVectorOperations::multiply(workspace.data() + firstPart, ring.data(), window.data() + firstPart, ringPosition);
+
+    fft->performRealOnlyForwardTransform(workspace.data(), true);
+
+    for (int i = 0; i < numBins; ++i)
+    {
+        spectrumReal[(size_t) i] = workspace[(size_t) i * 2];
+        spectrumImag[(size_t) i] = workspace[(size_t) i * 2 + 1];
+    }
+
+    SpectralKernels::magnitude(spectrumReal.data(), spectrumImag.data(), magnitudes.data(), numBins);
+}
+
+void SpectrumAnalyser::accumulate(std::vector<float>& average) noexcept
+{
+    const float coefficient = hasAverage ? averagingCoefficient : 0.0f;
+
+    switch (activeSettings.averaging)
+    {
+        case Averaging::none:
+            std::copy(magnitudes.begin(), magnitudes.end(), average.begin());
+            break;
+
+        case Averaging::exponential:
+            for (int i = 0; i < numBins; ++i)
+                average[(size_t) i] = coefficient * average[(size_t) i] + (1.0f - coefficient) * magnitudes[(size_t) i];
+            break;
+
+        case Averaging::rms:
+            // Averages power; getAverageMagnitude() takes the root when publishing
+            for (int i = 0; i < numBins; ++i)
+                average[(size_t) i] = coefficient * average[(size_t) i] + (1.0f - coefficient) * magnitudes[(size_t) i] * magnitudes[(size_t) i];
+            break;
+    }
+}
+
+void SpectrumAnalyser::getAverageMagnitude(const std::vector<float>& average, float* dest) const noexcept
+{
+    if (activeSettings.averaging == Averaging::rms)
+    {
+        for (int i = 0; i < numBins; ++i)
+            dest[i] = std::sqrt(average[(size_t) i]);
+    }
+    else
+    {
+        juce::FloatVectorOperations::copy(dest, average.data(), numBins);
+    }
+}
+
+void SpectrumAnalyser::analyseFrame()
+{
+    measure(inputRing);
+    accumulate(inputAverage);
+
+    measure(outputRing);
+    accumulate(outputAverage);
+
+    hasAverage = true;
+
+    // Publish straight into the triple buffer; the peaks follow the displayed output
+    auto& frame = spectrumBuffer.getWriteFrame();
+    frame.numBins = numBins;
+    frame.fftSize = fftSize;
+    frame.streamPosition = streamPosition;
+
+    getAverageMagnitude(inputAverage, frame.getTrace(inputTrace));
+    getAverageMagnitude(outputAverage, frame.getTrace(outputTrace));
+
+    const float* output = frame.getTrace(outputTrace);
+
+    if (activeSettings.peakHold)
+    {
+        for (int i = 0; i < numBins; ++i)
+            outputPeak[(size_t) i] = juce::jmax(outputPeak[(size_t) i] * peakDecay, output[i]);
+    }
+    else
+    {
+        std::copy(output, output + numBins, outputPeak.begin());
+    }
+
+    juce::FloatVectorOperations::copy(frame.getTrace(outputPeakTrace), outputPeak.data(), numBins);
+
+    spectrumBuffer.publish();
+}
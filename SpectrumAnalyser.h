@@ -0,0 +1,122 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SpectrumTripleBuffer.h"
+
+//==============================================================================
+/**
+ * SpectrumAnalyser
+ * Measures the spectra of the plugin's input and output on a background thread.
+ *
+ * The audio thread only downmixes each block into a lock-free FIFO; if the FIFO
+ * is full the block is dropped rather than waited for. The analyser thread
+ * drains the FIFO at its own pace, runs its own windowed FFT (whose size is
+ * independent of the processing engine's) and applies averaging and peak-hold
+ * before publishing each frame through a SpectrumTripleBuffer.
+ *
+ * The thread is only started the first time analysis is enabled and sleeps
+ * while it is disabled, so instances whose editor is never opened pay nothing.
+ */
+class SpectrumAnalyser : private juce::Thread
+{
+public:
+    //==============================================================================
+    enum class Averaging
+    {
+        none,           // every frame as measured
+        exponential,    // exponential moving average of the magnitudes
+        rms             // exponential moving average of the power, shown as a magnitude
+    };
+
+    struct Settings
+    {
+        int fftOrder = 11;
+        int overlap = 2;
+        Averaging averaging = Averaging::exponential;
+        float averagingTimeSeconds = 0.25f;     // time constant of the moving averages
+        bool peakHold = true;
+        float peakDecayDbPerSecond = 12.0f;
+    };
+
+    static constexpr int minFFTOrder = 8;       // 256
+    static constexpr int maxFFTOrder = 14;      // 16384
+
+    // Each published frame holds these traces, numBins values each
+    enum Trace
+    {
+        inputTrace = 0,
+        outputTrace,
+        outputPeakTrace,
+        numTraces
+    };
+
+    //==============================================================================
+    SpectrumAnalyser();
+    ~SpectrumAnalyser() override;
+
+    // Sets the sample rate the pushed audio runs at. Call from the message thread.
+    void prepare(double sampleRate);
+
+    // Takes effect on the analyser thread before its next frame
+    void setSettings(const Settings& newSettings);
+    Settings getSettings() const;
+
+    // Starts or pauses analysis. Cheap to call repeatedly with the same value.
+    void setEnabled(bool shouldBeEnabled);
+    bool isEnabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
+
+    // Audio thread: queues the channel average of numSamples of input and output,
+    // starting at the given sample of each buffer. Never blocks or allocates.
+    // Double buffers are narrowed to float as they are downmixed.
+    template <typename SampleType>
+    void pushSamples(const juce::AudioBuffer<SampleType>& input, int inputStartSample,
+                     const juce::AudioBuffer<SampleType>& output, int outputStartSample, int numSamples) noexcept;
+
+    // Consumer side of the analysis frames, for a single reader such as the editor
+    SpectrumTripleBuffer& getSpectrumBuffer() noexcept { return spectrumBuffer; }
+
+private:
+    //==============================================================================
+    void run() override;
+
+    void configure();
+    void drainFifo();
+    void consume(const float* input, const float* output, int numSamples);
+    void analyseFrame();
+    void measure(const std::vector<float>& ring);
+    void accumulate(std::vector<float>& average) noexcept;
+    void getAverageMagnitude(const std::vector<float>& average, float* dest) const noexcept;
+    void discardPendingAudio();
+
+    static constexpr int fifoSize = 1 << 15;
+    static constexpr int pollIntervalMs = 10;
+
+    // Audio thread -> analyser thread
+    juce::AbstractFifo fifo { fifoSize };
+    juce::HeapBlock<float> inputFifo, outputFifo;
+
+    std::atomic<bool> enabled { false };
+    std::atomic<double> currentSampleRate { 44100.0 };
+    std::atomic<bool> settingsChanged { true };
+
+    mutable juce::CriticalSection settingsLock;
+    Settings settings;
+
+    // Analyser thread only
+    Settings activeSettings;
+    int fftSize = 0, hopSize = 0, numBins = 0;
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<float> window, inputRing, outputRing, workspace;
+    std::vector<float> spectrumReal, spectrumImag, magnitudes;     // latest measured frame
+    std::vector<float> inputAverage, outputAverage, outputPeak;
+    int ringPosition = 0;
+    int samplesUntilNextHop = 0;
+    juce::int64 streamPosition = 0;
+    float averagingCoefficient = 0.0f;
+    float peakDecay = 0.0f;
+    bool hasAverage = false;
+
+    SpectrumTripleBuffer spectrumBuffer { (1 << maxFFTOrder) / 2 + 1, numTraces };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumAnalyser)
+};
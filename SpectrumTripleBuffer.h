@@ -0,0 +1,89 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/**
+ * SpectrumTripleBuffer
+ * Wait-free handoff of magnitude spectra from one producer thread to one
+ * consumer thread. A frame can carry several spectra of the same length
+ * (traces), e.g. the input and output of a process, so they always arrive
+ * together.
+ *
+ * There are three preallocated frames: one the producer is filling, one the
+ * consumer is reading, and one in the middle holding the latest complete frame.
+ * Publishing or fetching just swaps an index with the middle slot, so neither
+ * side ever waits for the other, and the consumer always sees the newest frame
+ * and skips any it was too slow for.
+ */
+class SpectrumTripleBuffer
+{
+public:
+    //==============================================================================
+    struct Frame
+    {
+        float* magnitudes = nullptr;    // trace 0: numBins values, DC to Nyquist
+        int numBins = 0;                // 0 until the first frame is published
+        int fftSize = 0;
+        juce::int64 streamPosition = 0;
+        int traceStride = 0;
+
+        float* getTrace(int trace) const noexcept { return magnitudes + (size_t) trace * (size_t) traceStride; }
+    };
+
+    // Allocates three frames of numTraces spectra of up to maxNumBins each.
+    // Must not be called on the audio thread.
+    explicit SpectrumTripleBuffer(int maxNumBins, int numTracesPerFrame = 1)
+        : capacity(maxNumBins), numTraces(numTracesPerFrame)
+    {
+        const size_t frameSize = (size_t) maxNumBins * (size_t) numTraces;
+        storage.calloc(frameSize * 3);
+
+        for (int i = 0; i < 3; ++i)
+        {
+            frames[i].magnitudes = storage.get() + frameSize * (size_t) i;
+            frames[i].traceStride = maxNumBins;
+        }
+    }
+
+    int getCapacity() const noexcept { return capacity; }
+    int getNumTraces() const noexcept { return numTraces; }
+
+    //==============================================================================
+    // Producer side: fill the frame returned here, then publish() it
+    Frame& getWriteFrame() noexcept { return frames[writeIndex]; }
+
+    void publish() noexcept
+    {
+        writeIndex = middle.exchange(writeIndex | freshFlag, std::memory_order_acq_rel) & indexMask;
+    }
+
+    //==============================================================================
+    // Consumer side: returns true if a newer frame has replaced the read frame
+    bool fetchLatest() noexcept
+    {
+        if ((middle.load(std::memory_order_relaxed) & freshFlag) == 0)
+            return false;
+
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const Frame& getReadFrame() const noexcept { return frames[readIndex]; }
+
+private:
+    //==============================================================================
+    static constexpr int indexMask = 3;
+    static constexpr int freshFlag = 4;
+
+    juce::HeapBlock<float> storage;
+    Frame frames[3];
+    const int capacity;
+    const int numTraces;
+
+    int writeIndex = 0;                 // producer only
+    int readIndex = 1;                  // consumer only
+    std::atomic<int> middle { 2 };      // index of the middle frame, plus freshFlag when it is unread
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpectrumTripleBuffer)
+};
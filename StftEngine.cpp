@@ -0,0 +1,693 @@
+﻿#include "StftEngine.h"
+
+//==============================================================================
+/**
+ * The engine for one FFT size and sample type. Every per-frame loop runs over a
+ * compile-time trip count, so each size gets its own fully specialised frame
+ * kernel. Float engines use juce::dsp::FFT; double engines use
+ * DoublePrecisionFFT, which has the same layout and scaling.
+ */
+template <int FftOrder, typename SampleType>
+class FixedSizeStftEngine final : public StftEngine
+{
+public:
+    static constexpr int size = 1 << FftOrder;
+    static constexpr int bins = size / 2 + 1;
+    static constexpr int ringMask = size - 1;
+
+    using FFT = std::conditional_t<std::is_same_v<SampleType, float>, juce::dsp::FFT, DoublePrecisionFFT>;
+
+    // DoublePrecisionFFT already runs each real transform as a half-size complex
+    // one, so only juce::dsp::FFT gains anything from sharing a transform
+    static constexpr bool canPairTransforms = std::is_same_v<SampleType, float>;
+
+    FixedSizeStftEngine(int hop, HopTracer& hopTracer)
+        : StftEngine(size, hop, std::is_same_v<SampleType, double>, hopTracer)
+    {
+        jassert(hopSize > 0 && size % hopSize == 0);
+
+        // A periodic Hann pair overlap-adds to a constant for hops of a third of
+        // the frame or less. At 50% overlap use root-Hann, whose square is Hann.
+        const bool useRootHann = hopSize * 3 > size;
+        const SampleType half = 0.5;
+        SampleType windowEnergy = 0;
+
+        for (int i = 0; i < size; ++i)
+        {
+            const SampleType hann = half - half * std::cos(SampleType(2) * juce::MathConstants<SampleType>::pi * i / size);
+            analysisWindow[i] = useRootHann ? std::sqrt(hann) : hann;
+            windowEnergy += analysisWindow[i] * analysisWindow[i];
+        }
+
+        // Scale the synthesis window so that an untouched spectrum reconstructs the input
+        const SampleType overlapAddGain = hopSize / windowEnergy;
+
+        for (int i = 0; i < size; ++i)
+            synthesisWindow[i] = analysisWindow[i] * overlapAddGain;
+    }
+
+    //==============================================================================
+    void prepare(int channelsToPrepare) override
+    {
+        numChannels = channelsToPrepare;
+        channels.clear();
+
+        arena.allocate(ChannelState::getRequiredArenaBytes() * (size_t) numChannels
+                       + SpectralWorkArena::bytesFor<SampleType>((size_t) (bins * numChannels)) * 2);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            channels.add(new ChannelState(arena));
+
+        spectrumReal = arena.take<SampleType>((size_t) (bins * numChannels));
+        spectrumImag = arena.take<SampleType>((size_t) (bins * numChannels));
+
+        reset();
+    }
+
+    void reset() noexcept override
+    {
+        for (auto* state : channels)
+            state->reset();
+
+        if (spectrumReal != nullptr)
+        {
+            juce::FloatVectorOperations::clear(spectrumReal, bins * numChannels);
+            juce::FloatVectorOperations::clear(spectrumImag, bins * numChannels);
+        }
+
+        ringPosition = 0;
+        samplesUntilNextHop = hopSize;
+        streamPosition = 0;
+        ringsCleared = true;
+    }
+
+    void skipSilence(int numSamples) noexcept override
+    {
+        if (!ringsCleared)
+        {
+            for (auto* state : channels)
+                state->reset();
+
+            ringsCleared = true;
+        }
+
+        // Advance the hop clock exactly as processBuffer() would
+        const int samplesSinceHop = hopSize - samplesUntilNextHop + numSamples;
+
+        ringPosition = (ringPosition + numSamples) & ringMask;
+        samplesUntilNextHop = hopSize - samplesSinceHop % hopSize;
+        streamPosition += numSamples;
+    }
+
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                 FrameCallback& callback, SpectralWorkerPool* pool) noexcept override
+    {
+        processBuffer(buffer, startSample, numSamples, callback, pool);
+    }
+
+    void process(juce::AudioBuffer<double>& buffer, int startSample, int numSamples,
+                 FrameCallback& callback, SpectralWorkerPool* pool) noexcept override
+    {
+        processBuffer(buffer, startSample, numSamples, callback, pool);
+    }
+
+private:
+    //==============================================================================
+    template <typename BufferType>
+    void processBuffer(juce::AudioBuffer<BufferType>& buffer, int startSample, int numSamples,
+                       FrameCallback& callback, SpectralWorkerPool* pool) noexcept
+    {
+        const int channelsToProcess = juce::jmin(channels.size(), buffer.getNumChannels());
+        ringsCleared = false;
+
+        while (numSamples > 0)
+        {
+            // Work in spans that end either at the block end or at the next hop boundary
+            const int spanLength = juce::jmin(numSamples, samplesUntilNextHop);
+            const int firstPart = juce::jmin(spanLength, size - ringPosition);
+            const int secondPart = spanLength - firstPart;
+
+            for (int channel = 0; channel < channelsToProcess; ++channel)
+                channels.getUnchecked(channel)->pushAndPop(buffer.getWritePointer(channel, startSample),
+                                                           ringPosition, firstPart, secondPart);
+
+            ringPosition = (ringPosition + spanLength) & ringMask;
+            samplesUntilNextHop -= spanLength;
+            streamPosition += spanLength;
+            startSample += spanLength;
+            numSamples -= spanLength;
+
+            if (samplesUntilNextHop == 0)
+            {
+                const bool useWorkers = pool != nullptr && pool->getNumWorkers() > 0 && channelsToProcess > 1;
+                const int numGroups = getNumGroups(channelsToProcess, useWorkers ? pool->getNumWorkers() + 1 : 1);
+
+                if (useWorkers && numGroups > 1)
+                {
+                    FrameJob job(*this, callback, channelsToProcess, numGroups);
+                    pool->run(job, numGroups);
+                }
+                else
+                {
+                    for (int group = 0; group < numGroups; ++group)
+                        processGroup(group * channelsToProcess / numGroups, (group + 1) * channelsToProcess / numGroups, callback);
+                }
+
+                samplesUntilNextHop = hopSize;
+            }
+        }
+    }
+
+    //==============================================================================
+    // Everything one channel needs to run a hop on its own
+    struct ChannelState
+    {
+        explicit ChannelState(SpectralWorkArena& arena)
+            : fft(FftOrder)
+        {
+            // Keep the per-frame buffers adjacent so a whole frame stays cache resident
+            inputRing = arena.take<SampleType>(size);
+            outputRing = arena.take<SampleType>(size);
+            fftWorkspace = arena.take<SampleType>(size * 2);
+        }
+
+        static size_t getRequiredArenaBytes() noexcept
+        {
+            return SpectralWorkArena::bytesFor<SampleType>(size) * 2
+                 + SpectralWorkArena::bytesFor<SampleType>(size * 2);
+        }
+
+        void reset() noexcept
+        {
+            juce::FloatVectorOperations::clear(inputRing, size);
+            juce::FloatVectorOperations::clear(outputRing, size);
+        }
+
+        template <typename BufferType>
+        void pushAndPop(BufferType* io, int ringPosition, int firstPart, int secondPart) noexcept
+        {
+            // Push the new input, then hand back the finished output and clear it for reuse
+            SampleConversion::copy(inputRing + ringPosition, io, firstPart);
+            SampleConversion::copy(inputRing, io + firstPart, secondPart);
+
+            SampleConversion::copy(io, outputRing + ringPosition, firstPart);
+            SampleConversion::copy(io + firstPart, outputRing, secondPart);
+
+            juce::FloatVectorOperations::clear(outputRing + ringPosition, firstPart);
+            juce::FloatVectorOperations::clear(outputRing, secondPart);
+        }
+
+        FFT fft;                                // one per channel, so hops never contend
+
+        SampleType* inputRing = nullptr;        // size
+        SampleType* outputRing = nullptr;       // size
+        SampleType* fftWorkspace = nullptr;     // size * 2, in-place real FFT
+
+        JUCE_DECLARE_NON_COPYABLE(ChannelState)
+    };
+
+    struct FrameJob : public SpectralWorkerPool::Job
+    {
+        FrameJob(FixedSizeStftEngine& e, FrameCallback& c, int channelsToProcess, int groups)
+            : engine(e), callback(c), numChannels(channelsToProcess), numGroups(groups) {}
+
+        void runJobItem(int group) noexcept override
+        {
+            engine.processGroup(group * numChannels / numGroups, (group + 1) * numChannels / numGroups, callback);
+        }
+
+        FixedSizeStftEngine& engine;
+        FrameCallback& callback;
+        const int numChannels, numGroups;
+    };
+
+    // Enough groups to keep every thread busy, each no wider than maxGroupChannels.
+    // Group g covers channels g * n / numGroups up to (g + 1) * n / numGroups.
+    static int getNumGroups(int channelsToProcess, int numThreads) noexcept
+    {
+        const int groupsForWidth = (channelsToProcess + maxGroupChannels - 1) / maxGroupChannels;
+        return juce::jmax(groupsForWidth, juce::jmin(channelsToProcess, numThreads));
+    }
+
+    //==============================================================================
+    // One hop for channels [firstChannel, endChannel): every channel is analysed
+    // into the group's interleaved spectra, the callback sees them all at once,
+    // then every channel is resynthesised
+    void processGroup(int firstChannel, int endChannel, FrameCallback& callback) noexcept
+    {
+        const int numLanes = endChannel - firstChannel;
+        SampleType* real = spectrumReal + bins * firstChannel;
+        SampleType* imag = spectrumImag + bins * firstChannel;
+        int numPairedLanes = 0;
+
+        if constexpr (canPairTransforms)
+        {
+            if (pairedTransforms)
+            {
+                numPairedLanes = numLanes & ~1;
+
+                for (int lane = 0; lane < numPairedLanes; lane += 2)
+                    analysePair(firstChannel + lane, real + lane, imag + lane, numLanes);
+            }
+        }
+
+        for (int lane = numPairedLanes; lane < numLanes; ++lane)
+            analyseFrame(*channels.getUnchecked(firstChannel + lane), firstChannel + lane, real + lane, imag + lane, numLanes);
+
+        {
+            HopTracer::Scope traceScope(tracer, HopTracer::Stage::spectralProcessing, firstChannel);
+            callback.processSpectra(real, imag, bins, numLanes, firstChannel, streamPosition);
+        }
+
+        if constexpr (canPairTransforms)
+            for (int lane = 0; lane < numPairedLanes; lane += 2)
+                resynthesisePair(firstChannel + lane, real + lane, imag + lane, numLanes);
+
+        for (int lane = numPairedLanes; lane < numLanes; ++lane)
+            resynthesiseFrame(*channels.getUnchecked(firstChannel + lane), firstChannel + lane, real + lane, imag + lane, numLanes);
+    }
+
+    // Windows and transforms the channel's frame, writing bin i to real[i * stride]
+    void analyseFrame(ChannelState& state, int channel, SampleType* real, SampleType* imag, int stride) noexcept
+    {
+        // The ring holds exactly one frame, whose oldest sample sits at ringPosition
+        const int firstPart = size - ringPosition;
+        SampleType* workspace = state.fftWorkspace;
+
+        // Window straight out of the ring into the FFT workspace
+        {
+            HopTracer::Scope traceScope(tracer, HopTracer::Stage::window, channel);
+            juce::FloatVectorOperations::multiply(workspace, state.inputRing + ringPosition, analysisWindow.data(), firstPart);
+            juce::FloatVectorOperations::multiply(workspace + firstPart, state.inputRing, analysisWindow.data() + firstPart, ringPosition);
+        }
+
+        // Only the non-negative half is computed; the inverse rebuilds the mirror itself
+        HopTracer::Scope traceScope(tracer, HopTracer::Stage::forwardFFT, channel);
+        state.fft.performRealOnlyForwardTransform(workspace, true);
+
+        for (int i = 0; i < bins; ++i)
+        {
+            real[i * stride] = workspace[i * 2];
+            imag[i * stride] = workspace[i * 2 + 1];
+        }
+    }
+
+    // Transforms the channel's processed spectrum back and overlap-adds it
+    void resynthesiseFrame(ChannelState& state, int channel, const SampleType* real, const SampleType* imag, int stride) noexcept
+    {
+        const int firstPart = size - ringPosition;
+        SampleType* workspace = state.fftWorkspace;
+
+        {
+            HopTracer::Scope traceScope(tracer, HopTracer::Stage::inverseFFT, channel);
+
+            for (int i = 0; i < bins; ++i)
+            {
+                workspace[i * 2] = real[i * stride];
+                workspace[i * 2 + 1] = imag[i * stride];
+            }
+
+            state.fft.performRealOnlyInverseTransform(workspace);
+        }
+
+        // Overlap-add the resynthesised frame, aligned with the input it came from
+        HopTracer::Scope traceScope(tracer, HopTracer::Stage::overlapAdd, channel);
+        juce::FloatVectorOperations::addWithMultiply(state.outputRing + ringPosition, workspace, synthesisWindow.data(), firstPart);
+        juce::FloatVectorOperations::addWithMultiply(state.outputRing, workspace + firstPart, synthesisWindow.data() + firstPart, ringPosition);
+    }
+
+    //==============================================================================
+    // Runs channels channel and channel + 1 through one complex FFT. Packing them
+    // as z = a + jb gives Z = A + jB, and since a and b are real their spectra
+    // come apart again as A[k] = (Z[k] + Z*[N - k]) / 2, B[k] = (Z[k] - Z*[N - k]) / 2j.
+    // Writes A to real[i * stride] and B to real[i * stride + 1].
+    void analysePair(int channel, SampleType* real, SampleType* imag, int stride) noexcept
+    {
+        auto& first = *channels.getUnchecked(channel);
+        auto& second = *channels.getUnchecked(channel + 1);
+
+        // Each workspace holds size complex values: the first is the FFT input, the second its output
+        auto* packed = reinterpret_cast<juce::dsp::Complex<float>*>(first.fftWorkspace);
+        auto* spectrum = reinterpret_cast<juce::dsp::Complex<float>*>(second.fftWorkspace);
+        const int firstPart = size - ringPosition;
+
+        {
+            HopTracer::Scope traceScope(tracer, HopTracer::Stage::window, channel);
+
+            for (int i = 0; i < firstPart; ++i)
+                packed[i] = { first.inputRing[ringPosition + i] * analysisWindow[i], second.inputRing[ringPosition + i] * analysisWindow[i] };
+
+            for (int i = firstPart; i < size; ++i)
+                packed[i] = { first.inputRing[i - firstPart] * analysisWindow[i], second.inputRing[i - firstPart] * analysisWindow[i] };
+        }
+
+        HopTracer::Scope traceScope(tracer, HopTracer::Stage::forwardFFT, channel);
+        first.fft.perform(packed, spectrum, false);
+
+        for (int i = 0; i < bins; ++i)
+        {
+            const auto z = spectrum[i];
+            const auto mirror = std::conj(spectrum[(size - i) & ringMask]);
+            const auto sum = (z + mirror) * 0.5f;          // A
+            const auto difference = (z - mirror) * 0.5f;   // jB
+
+            real[i * stride] = sum.real();
+            imag[i * stride] = sum.imag();
+            real[i * stride + 1] = difference.imag();
+            imag[i * stride + 1] = -difference.real();
+        }
+    }
+
+    // The inverse of analysePair: rebuilds Z = A + jB over the whole circle from
+    // the conjugate symmetry of A and B, and overlap-adds its real part into the
+    // first channel and its imaginary part into the second
+    void resynthesisePair(int channel, const SampleType* real, const SampleType* imag, int stride) noexcept
+    {
+        auto& first = *channels.getUnchecked(channel);
+        auto& second = *channels.getUnchecked(channel + 1);
+        auto* packed = reinterpret_cast<juce::dsp::Complex<float>*>(first.fftWorkspace);
+        auto* signal = reinterpret_cast<juce::dsp::Complex<float>*>(second.fftWorkspace);
+        const int firstPart = size - ringPosition;
+
+        {
+            HopTracer::Scope traceScope(tracer, HopTracer::Stage::inverseFFT, channel);
+
+            // A real inverse ignores the imaginary parts at DC and Nyquist, and so must this
+            packed[0] = { real[0], real[1] };
+            packed[size / 2] = { real[(bins - 1) * stride], real[(bins - 1) * stride + 1] };
+
+            for (int i = 1; i < bins - 1; ++i)
+            {
+                const float aReal = real[i * stride], aImag = imag[i * stride];
+                const float bReal = real[i * stride + 1], bImag = imag[i * stride + 1];
+
+                packed[i] = { aReal - bImag, aImag + bReal };              // A + jB
+                packed[size - i] = { aReal + bImag, bReal - aImag };       // A* + jB*
+            }
+
+            first.fft.perform(packed, signal, true);
+        }
+
+        HopTracer::Scope traceScope(tracer, HopTracer::Stage::overlapAdd, channel);
+
+        for (int i = 0; i < firstPart; ++i)
+        {
+            first.outputRing[ringPosition + i] += signal[i].real() * synthesisWindow[i];
+            second.outputRing[ringPosition + i] += signal[i].imag() * synthesisWindow[i];
+        }
+
+        for (int i = firstPart; i < size; ++i)
+        {
+            first.outputRing[i - firstPart] += signal[i].real() * synthesisWindow[i];
+            second.outputRing[i - firstPart] += signal[i].imag() * synthesisWindow[i];
+        }
+    }
+
+    //==============================================================================
+    std::array<SampleType, size> analysisWindow {};
+    std::array<SampleType, size> synthesisWindow {};        // includes the overlap-add normalisation
+
+    SpectralWorkArena arena;
+    juce::OwnedArray<ChannelState> channels;
+
+    // bins * numChannels each. A hop's groups are contiguous channel ranges, and
+    // each group's spectra sit channel-interleaved in its own slice of these.
+    SampleType* spectrumReal = nullptr;
+    SampleType* spectrumImag = nullptr;
+
+    // Shared hop clock: every channel sees the same number of samples per block
+    int ringPosition = 0;
+    int samplesUntilNextHop = 0;
+    juce::int64 streamPosition = 0;
+    bool ringsCleared = true;               // nothing processed since the last reset or skipSilence()
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FixedSizeStftEngine)
+};
+
+//==============================================================================
+/**
+ * The hybrid. Both engines see the whole input, and complementary band masks
+ * applied to each engine's spectra after the callback crossfade it between
+ * them: the large engine keeps the lows, the small engine the highs, with a
+ * raised-cosine crossfade from crossoverStart to crossoverEnd small-FFT bins
+ * (375 Hz to 3 kHz at 48 kHz).
+ *
+ * Two bands with different delays would comb wherever they overlap, so the
+ * small engine's output is delayed to line up with the large engine's, and
+ * the hybrid reports the large engine's latency. With the spectra untouched,
+ * the bands then sum to a flat response.
+ */
+class HybridStftEngine final : public StftEngine
+{
+public:
+    HybridStftEngine(std::unique_ptr<StftEngine> large, std::unique_ptr<StftEngine> small, HopTracer& hopTracer)
+        : StftEngine(large->getFFTSize(), large->getHopSize(), large->isDoublePrecision(), hopTracer),
+          lateEngine(std::move(large)), earlyEngine(std::move(small))
+    {
+        latencySamples = lateEngine->getLatencyInSamples();
+        lowLatencyFFTSize = earlyEngine->getFFTSize();
+        delayLength = latencySamples - earlyEngine->getLatencyInSamples();
+
+        lowBandWeights.malloc((size_t) lateEngine->getNumBins());
+        highBandWeights.malloc((size_t) earlyEngine->getNumBins());
+
+        // Both masks are taken at the bin's frequency, so they sum to one everywhere
+        for (int bin = 0; bin < lateEngine->getNumBins(); ++bin)
+            lowBandWeights[bin] = 1.0f - getHighBandWeight(bin * (double) lowLatencyFFTSize / fftSize);
+
+        for (int bin = 0; bin < earlyEngine->getNumBins(); ++bin)
+            highBandWeights[bin] = getHighBandWeight(bin);
+    }
+
+    //==============================================================================
+    void prepare(int channelsToPrepare) override
+    {
+        numChannels = channelsToPrepare;
+        lateEngine->prepare(numChannels);
+        earlyEngine->prepare(numChannels);
+
+        // The large engine's input/output and the small engine's delay line, in the
+        // precision the engines were built for
+        if (doublePrecision)
+        {
+            doubleScratch.setSize(numChannels, scratchLength);
+            doubleDelayLine.setSize(numChannels, delayLength);
+        }
+        else
+        {
+            floatScratch.setSize(numChannels, scratchLength);
+            floatDelayLine.setSize(numChannels, delayLength);
+        }
+
+        clearDelayLines();
+    }
+
+    void reset() noexcept override
+    {
+        lateEngine->reset();
+        earlyEngine->reset();
+        clearDelayLines();
+    }
+
+    void skipSilence(int numSamples) noexcept override
+    {
+        lateEngine->skipSilence(numSamples);
+        earlyEngine->skipSilence(numSamples);
+
+        // The small engine's output went silent before the large engine's did, so
+        // the delay line only holds silence and its residue; clear that once
+        if (!delayLinesCleared)
+            clearDelayLines();
+    }
+
+    void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                 FrameCallback& callback, SpectralWorkerPool* pool) noexcept override
+    {
+        processBuffer(buffer, floatScratch, floatDelayLine, startSample, numSamples, callback, pool);
+    }
+
+    void process(juce::AudioBuffer<double>& buffer, int startSample, int numSamples,
+                 FrameCallback& callback, SpectralWorkerPool* pool) noexcept override
+    {
+        processBuffer(buffer, doubleScratch, doubleDelayLine, startSample, numSamples, callback, pool);
+    }
+
+private:
+    //==============================================================================
+    // 0 below crossoverStart, 1 above crossoverEnd, at a position in small-FFT bins
+    static float getHighBandWeight(double smallBin) noexcept
+    {
+        const double fade = juce::jlimit(0.0, 1.0, (smallBin - crossoverStart) / (crossoverEnd - crossoverStart));
+        return (float) (0.5 - 0.5 * std::cos(juce::MathConstants<double>::pi * fade));
+    }
+
+    void clearDelayLines() noexcept
+    {
+        floatDelayLine.clear();
+        doubleDelayLine.clear();
+        delayPosition = 0;
+        delayLinesCleared = true;
+    }
+
+    // Swaps numSamples of each channel with the delay line, so they come out delayLength later
+    template <typename SampleType>
+    void delayEarlyBand(juce::AudioBuffer<SampleType>& buffer, juce::AudioBuffer<SampleType>& delayLine,
+                        int startSample, int numSamples, int channelsToProcess) noexcept
+    {
+        for (int channel = 0; channel < channelsToProcess; ++channel)
+        {
+            auto* data = buffer.getWritePointer(channel, startSample);
+            auto* line = delayLine.getWritePointer(channel);
+            int position = delayPosition;
+
+            for (int i = 0; i < numSamples; ++i)
+            {
+                std::swap(data[i], line[position]);
+
+                if (++position == delayLength)
+                    position = 0;
+            }
+        }
+
+        delayPosition = (delayPosition + numSamples) % delayLength;
+        delayLinesCleared = false;
+    }
+
+    //==============================================================================
+    // Passes the spectra on, then keeps only the engine's band
+    struct BandCallback : public FrameCallback
+    {
+        BandCallback(FrameCallback& c, const float* w) : callback(c), weights(w) {}
+
+        void processSpectra(float* real, float* imag, int numBins, int numChannels,
+                            int firstChannel, juce::int64 streamPosition) override
+        {
+            callback.processSpectra(real, imag, numBins, numChannels, firstChannel, streamPosition);
+            applyWeights(real, imag, numBins, numChannels);
+        }
+
+        void processSpectra(double* real, double* imag, int numBins, int numChannels,
+                            int firstChannel, juce::int64 streamPosition) override
+        {
+            callback.processSpectra(real, imag, numBins, numChannels, firstChannel, streamPosition);
+            applyWeights(real, imag, numBins, numChannels);
+        }
+
+        template <typename SampleType>
+        void applyWeights(SampleType* real, SampleType* imag, int numBins, int numChannels) const noexcept
+        {
+            for (int bin = 0; bin < numBins; ++bin)
+            {
+                const auto weight = static_cast<SampleType>(weights[bin]);
+
+                for (int channel = 0; channel < numChannels; ++channel)
+                {
+                    real[bin * numChannels + channel] *= weight;
+                    imag[bin * numChannels + channel] *= weight;
+                }
+            }
+        }
+
+        FrameCallback& callback;
+        const float* weights;
+    };
+
+    template <typename BufferType>
+    void processBuffer(juce::AudioBuffer<BufferType>& buffer, juce::AudioBuffer<BufferType>& lateBuffer,
+                       juce::AudioBuffer<BufferType>& delayLine, int startSample, int numSamples,
+                       FrameCallback& callback, SpectralWorkerPool* pool) noexcept
+    {
+        const int channelsToProcess = juce::jmin(buffer.getNumChannels(), lateBuffer.getNumChannels());
+        BandCallback lowBand(callback, lowBandWeights), highBand(callback, highBandWeights);
+
+        lateEngine->setPairedTransforms(pairedTransforms);
+        earlyEngine->setPairedTransforms(pairedTransforms);
+
+        // Both engines are hop-granular, so working through in scratch-sized chunks changes nothing
+        while (numSamples > 0)
+        {
+            const int chunkLength = juce::jmin(numSamples, scratchLength);
+
+            for (int channel = 0; channel < channelsToProcess; ++channel)
+                lateBuffer.copyFrom(channel, 0, buffer, channel, startSample, chunkLength);
+
+            lateEngine->process(lateBuffer, 0, chunkLength, lowBand, pool);
+            earlyEngine->process(buffer, startSample, chunkLength, highBand, pool);
+            delayEarlyBand(buffer, delayLine, startSample, chunkLength, channelsToProcess);
+
+            for (int channel = 0; channel < channelsToProcess; ++channel)
+                buffer.addFrom(channel, startSample, lateBuffer, channel, 0, chunkLength);
+
+            startSample += chunkLength;
+            numSamples -= chunkLength;
+        }
+    }
+
+    //==============================================================================
+    // The crossfade, in small-FFT bins: it starts at the lowest frequency the small FFT
+    // resolves and is wide enough for that FFT's window leakage to even out, keeping
+    // the sum within 0.1 dB of flat
+    static constexpr double crossoverStart = 1.0;
+    static constexpr double crossoverEnd = 8.0;
+    static constexpr int scratchLength = 512;
+
+    std::unique_ptr<StftEngine> lateEngine, earlyEngine;
+    juce::HeapBlock<float> lowBandWeights, highBandWeights;
+    juce::AudioBuffer<float> floatScratch;
+    juce::AudioBuffer<double> doubleScratch;
+
+    // Delays the small engine's output by the difference in latency
+    juce::AudioBuffer<float> floatDelayLine;
+    juce::AudioBuffer<double> doubleDelayLine;
+    int delayLength = 0;
+    int delayPosition = 0;
+    bool delayLinesCleared = true;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HybridStftEngine)
+};
+
+//==============================================================================
+namespace
+{
+    template <typename SampleType>
+    std::unique_ptr<StftEngine> createForSampleType(int fftOrder, int hop, HopTracer& tracer)
+    {
+        switch (fftOrder)
+        {
+            case StftEngine::lowLatencyFFTOrder:
+                return std::make_unique<FixedSizeStftEngine<StftEngine::lowLatencyFFTOrder, SampleType>>(hop, tracer);
+            case 9:  return std::make_unique<FixedSizeStftEngine<9, SampleType>>(hop, tracer);
+            case 10: return std::make_unique<FixedSizeStftEngine<10, SampleType>>(hop, tracer);
+            case 11: return std::make_unique<FixedSizeStftEngine<11, SampleType>>(hop, tracer);
+            case 12: return std::make_unique<FixedSizeStftEngine<12, SampleType>>(hop, tracer);
+            case 13: return std::make_unique<FixedSizeStftEngine<13, SampleType>>(hop, tracer);
+            case 14: return std::make_unique<FixedSizeStftEngine<14, SampleType>>(hop, tracer);
+            default: break;
+        }
+
+        jassertfalse;
+        return {};
+    }
+}
+
+std::unique_ptr<StftEngine> StftEngine::create(int fftOrder, int overlap, HopTracer& tracer, bool useDoublePrecision, bool lowLatency)
+{
+    jassert(fftOrder >= minFFTOrder && fftOrder <= maxFFTOrder);
+    jassert(overlap >= 2 && juce::isPowerOfTwo(overlap));
+
+    fftOrder = juce::jlimit(minFFTOrder, maxFFTOrder, fftOrder);
+    overlap = juce::jmax(2, overlap);
+
+    auto createEngine = [&](int order)
+    {
+        const int hop = (1 << order) / overlap;
+
+        return useDoublePrecision ? createForSampleType<double>(order, hop, tracer)
+                                  : createForSampleType<float>(order, hop, tracer);
+    };
+
+    if (lowLatency)
+        return std::make_unique<HybridStftEngine>(createEngine(fftOrder), createEngine(lowLatencyFFTOrder), tracer);
+
+    return createEngine(fftOrder);
+}
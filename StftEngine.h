@@ -0,0 +1,150 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SpectralWorkArena.h"
+#include "SpectralWorkerPool.h"
+#include "HopTracer.h"
+#include "DoublePrecisionFFT.h"
+#include "SampleConversion.h"
+
+//==============================================================================
+/**
+ * StftEngine
+ * Hop-granular short-time Fourier transform with overlap-add resynthesis.
+ *
+ * Incoming audio is copied in contiguous spans into a power-of-two ring buffer.
+ * Every hopSize samples a full frame is windowed, transformed, handed to a
+ * FrameCallback for spectral processing, transformed back and overlap-added
+ * into the output ring. The engine adds exactly getLatencyInSamples() of delay.
+ *
+ * Spectra are kept in the real FFT's native half-spectrum form (bins 0 to
+ * fftSize / 2 inclusive) as split real/imaginary arrays, so no negative-frequency
+ * mirror is needed. Every hop, the channels are split into groups of up to
+ * maxGroupChannels, and each group's spectra are stored channel-interleaved so
+ * the callback can run one loop over the bins with the group's channels in the
+ * SIMD lanes; per-bin factors are then computed once for all of them.
+ *
+ * Float engines can run each pair of channels in a group through one complex
+ * FFT, the first channel in the real part and the second in the imaginary part,
+ * which replaces two real transforms in each direction with one.
+ *
+ * In hybrid mode, create() returns a hybrid of two engines: a small FFT
+ * carries the high frequencies, where its time resolution keeps transients
+ * sharp, and the full-size FFT carries the lows, where its frequency
+ * resolution matters. See getLowLatencyFFTSize().
+ *
+ * Each channel owns its rings, FFT and scratch, and each group its slice of the
+ * spectra, so the groups of one hop can run concurrently on a SpectralWorkerPool.
+ * With a pool, channels are spread over at least as many groups as there are
+ * threads to run them.
+ *
+ * The FFT size and the sample type the engine works in are compile-time
+ * constants of each concrete engine; use create() to get the specialisation for
+ * a runtime order and precision. Either precision accepts float and double
+ * buffers, converting at the ring boundary if they differ from its own. Engines
+ * own their memory, so they can be built and prepared on the message thread
+ * and swapped in whole.
+ */
+class StftEngine
+{
+public:
+    //==============================================================================
+    // Receives the spectra of every frame, between the forward and inverse FFT
+    struct FrameCallback
+    {
+        virtual ~FrameCallback() = default;
+
+        // The spectra of numChannels consecutive engine channels, starting at
+        // firstChannel, each numBins = fftSize / 2 + 1 values from DC to Nyquist,
+        // stored channel-interleaved: bin i of the group's channel c is at
+        // real[i * numChannels + c]. numChannels is at most maxGroupChannels.
+        // streamPosition is the number of samples the engine had consumed when
+        // the frame completed, counted from the last reset(), so anything derived
+        // from it is identical in realtime and offline renders.
+        // When a worker pool is in use this is called for different groups at
+        // the same time, so implementations must only touch per-channel state.
+        virtual void processSpectra(float* real, float* imag, int numBins, int numChannels,
+                                    int firstChannel, juce::int64 streamPosition) = 0;
+
+        // The same for engines that work in double precision
+        virtual void processSpectra(double* real, double* imag, int numBins, int numChannels,
+                                    int firstChannel, juce::int64 streamPosition) = 0;
+    };
+
+    //==============================================================================
+    static constexpr int minFFTOrder = 9;       // 512
+    static constexpr int maxFFTOrder = 14;      // 16384
+
+    // The high band of a hybrid engine: 2.7 ms frames at 48 kHz
+    static constexpr int lowLatencyFFTOrder = 7;    // 128
+
+    // Widest channel group handed to the callback: 8 floats fill an AVX register
+    static constexpr int maxGroupChannels = 8;
+
+    // Builds the engine specialised for 2^fftOrder points, hopping fftSize / overlap,
+    // that keeps its rings and spectra in double rather than float if asked to.
+    // With lowLatency set, the hybrid engine adds a 2^lowLatencyFFTOrder-point
+    // engine for the high band, delayed to line up with the large one, so it
+    // reports the same latency as a plain engine; the callback then sees the
+    // spectra of both sizes. The tracer receives the stages of every hop and
+    // must outlive the engine.
+    static std::unique_ptr<StftEngine> create(int fftOrder, int overlap, HopTracer& tracer,
+                                              bool useDoublePrecision = false, bool lowLatency = false);
+
+    virtual ~StftEngine() = default;
+
+    // Allocates all working buffers. Must not be called on the audio thread.
+    virtual void prepare(int numChannels) = 0;
+    virtual void reset() noexcept = 0;
+
+    // Processes numSamples of buffer in place, starting at startSample. If a
+    // pool is given, the channels' hops are spread across its workers.
+    virtual void process(juce::AudioBuffer<float>& buffer, int startSample, int numSamples,
+                         FrameCallback& callback, SpectralWorkerPool* pool = nullptr) noexcept = 0;
+    virtual void process(juce::AudioBuffer<double>& buffer, int startSample, int numSamples,
+                         FrameCallback& callback, SpectralWorkerPool* pool = nullptr) noexcept = 0;
+
+    // Stands in for process() over numSamples of silence once the engine's
+    // output has gone silent, i.e. getTailLengthInSamples() after its input did.
+    // The rings are cleared once and only the hop clock advances, so the hops
+    // after the next process() line up as if every hop had run. The caller
+    // fills the output with silence.
+    virtual void skipSilence(int numSamples) noexcept = 0;
+
+    //==============================================================================
+    int getFFTSize() const noexcept { return fftSize; }
+    int getHopSize() const noexcept { return hopSize; }
+    int getNumBins() const noexcept { return fftSize / 2 + 1; }
+    int getNumChannels() const noexcept { return numChannels; }
+    int getLatencyInSamples() const noexcept { return latencySamples; }
+    bool isDoublePrecision() const noexcept { return doublePrecision; }
+
+    // FFT size of a hybrid engine's high band, or 0 for a plain engine.
+    // Both bands arrive getLatencyInSamples() after the input.
+    int getLowLatencyFFTSize() const noexcept { return lowLatencyFFTSize; }
+
+    // Samples after the input goes silent until the output does: a frame for
+    // the input to leave the input ring and another to drain the output ring
+    int getTailLengthInSamples() const noexcept { return 2 * fftSize; }
+
+    // Lets float engines share one complex FFT between each pair of channels.
+    // Double engines ignore it, as their FFT already packs each real transform
+    // into a half-size complex one. Call from the thread that calls process().
+    void setPairedTransforms(bool shouldPair) noexcept { pairedTransforms = shouldPair; }
+
+protected:
+    StftEngine(int size, int hop, bool isDouble, HopTracer& t)
+        : fftSize(size), hopSize(hop), doublePrecision(isDouble), latencySamples(size), tracer(t) {}
+
+    const int fftSize;
+    const int hopSize;
+    const bool doublePrecision;
+    int latencySamples;
+    int lowLatencyFFTSize = 0;
+    bool pairedTransforms = false;
+    int numChannels = 0;
+    HopTracer& tracer;
+
+private:
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StftEngine)
+};
@@ -0,0 +1,304 @@
+﻿#include <JuceHeader.h>
+#include "../../PluginProcessor.h"
+
+//==============================================================================
+/**
+ * NewVerbTk1 processBlock benchmark
+ * Drives NewVerbTk1AudioProcessor with seeded white noise and times every
+ * processBlock call.
+ *
+ *   NewVerbTk1Benchmark [--quick] [--seconds <s>] [--isa scalar|sse2|avx2|avx512]
+ *                       [--unpaired] [--output <file.json>] [--trace <file.json>]
+ *
+ * Sweeps FFT orders, channel counts, block sizes (including sizes that don't
+ * divide the hop) and parameter scenarios at their extremes. Each case reports
+ * ns/sample, hops/sec and the p50, p99 and maximum block times as JSON, on
+ * stdout unless --output is given, so runs can be diffed and tracked over time.
+ * --unpaired gives every channel its own real FFTs instead of pairing them.
+ * --trace writes a Chrome trace of each case's timed blocks next to the given
+ * file, named after the case; the tracing itself adds to the block times.
+ */
+namespace
+{
+    constexpr double benchmarkSampleRate = 48000.0;
+    constexpr int benchmarkOverlap = 4;
+
+    struct Scenario
+    {
+        const char* name;
+        std::vector<std::pair<const char*, float>> parameterValues;
+    };
+
+    const Scenario scenarios[] =
+    {
+        { "default",  {} },
+        { "size_max", { { "size", 1.0f } } },
+        { "density_max", { { "density", 1.0f } } },
+        { "freeze", { { "freeze", 1.0f } } },
+        { "all_extremes", { { "size", 1.0f }, { "density", 1.0f }, { "damping", 1.0f }, { "time", 10.0f } } }
+    };
+
+    struct Options
+    {
+        bool quick = false;
+        double secondsPerCase = 2.0;
+        juce::String instructionSet;
+        bool pairedTransforms = true;
+        juce::File outputFile;
+        juce::File traceFile;
+    };
+
+    struct Case
+    {
+        int fftOrder, numChannels, blockSize;
+        const Scenario* scenario;
+    };
+
+    //==============================================================================
+    juce::Array<Case> buildCases(const Options& options)
+    {
+        const juce::Array<int> fftOrders = options.quick ? juce::Array<int> { 10, 12, 14 }
+                                                         : juce::Array<int> { 9, 10, 11, 12, 13, 14 };
+        const juce::Array<int> channelCounts = options.quick ? juce::Array<int> { 1, 2, 12 }
+                                                             : juce::Array<int> { 1, 2, 6, 12 };
+        const juce::Array<int> blockSizes = options.quick ? juce::Array<int> { 1, 64, 441, 1024, 8192 }
+                                                          : juce::Array<int> { 1, 7, 32, 64, 128, 256, 441, 512, 1000, 1024, 2048, 3000, 4096, 8192 };
+
+        juce::Array<Case> cases;
+
+        for (const auto& scenario : scenarios)
+            for (int order : fftOrders)
+                for (int channels : channelCounts)
+                    for (int blockSize : blockSizes)
+                        cases.add({ order, channels, blockSize, &scenario });
+
+        return cases;
+    }
+
+    double getPercentile(std::vector<double>& sortedValues, double percentile)
+    {
+        if (sortedValues.empty())
+            return 0.0;
+
+        const auto index = (size_t) juce::jlimit(0.0, (double) sortedValues.size() - 1.0, std::ceil(percentile * sortedValues.size()) - 1.0);
+        return sortedValues[index];
+    }
+
+    // e.g. trace.json -> trace_default_fft4096_ch2_b441.json
+    juce::File getTraceFile(const juce::File& traceFile, const Case& c)
+    {
+        const auto suffix = juce::String("_") + c.scenario->name + "_fft" + juce::String(1 << c.fftOrder)
+                          + "_ch" + juce::String(c.numChannels) + "_b" + juce::String(c.blockSize);
+
+        return traceFile.getSiblingFile(traceFile.getFileNameWithoutExtension() + suffix + traceFile.getFileExtension());
+    }
+
+    //==============================================================================
+    juce::var runCase(const Case& c, const Options& options)
+    {
+        NewVerbTk1AudioProcessor processor;
+
+        const auto channelSet = juce::AudioChannelSet::canonicalChannelSet(c.numChannels);
+        juce::AudioProcessor::BusesLayout layout;
+        layout.inputBuses.add(channelSet);
+        layout.outputBuses.add(channelSet);
+        processor.setBusesLayout(layout);
+        processor.setPairedTransforms(options.pairedTransforms);
+
+        // Parameters first, so prepareToPlay builds the engine at the requested size
+        auto setParameter = [&processor](const char* parameterID, float value)
+        {
+            if (auto* parameter = processor.parameters.getParameter(parameterID))
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+        };
+
+        setParameter("fft_size", (float) (c.fftOrder - StftEngine::minFFTOrder));
+        setParameter("overlap", (float) (juce::roundToInt(std::log2(benchmarkOverlap)) - 1));
+
+        for (const auto& value : c.scenario->parameterValues)
+            setParameter(value.first, value.second);
+
+        processor.setRateAndBufferSizeDetails(benchmarkSampleRate, c.blockSize);
+        processor.prepareToPlay(benchmarkSampleRate, c.blockSize);
+
+        juce::AudioBuffer<float> buffer(c.numChannels, c.blockSize);
+        juce::MidiBuffer midi;
+        juce::Random random(0x4e565431);
+
+        auto fillWithNoise = [&]
+        {
+            for (int channel = 0; channel < c.numChannels; ++channel)
+            {
+                auto* data = buffer.getWritePointer(channel);
+
+                for (int i = 0; i < c.blockSize; ++i)
+                    data[i] = (random.nextFloat() * 2.0f - 1.0f) * 0.25f;
+            }
+        };
+
+        // Warm up for one full frame plus some, so every buffer and cache is primed
+        const int warmupSamples = (1 << c.fftOrder) + (int) benchmarkSampleRate / 4;
+
+        for (int done = 0; done < warmupSamples; done += c.blockSize)
+        {
+            fillWithNoise();
+            processor.processBlock(buffer, midi);
+        }
+
+        // Only the processBlock call is timed; generating the input is not
+        const int numBlocks = juce::jmax(16, (int) (options.secondsPerCase * benchmarkSampleRate / c.blockSize));
+        const double ticksToNs = 1.0e9 / (double) juce::Time::getHighResolutionTicksPerSecond();
+
+        std::vector<double> blockTimesNs;
+        blockTimesNs.reserve((size_t) numBlocks);
+        double totalNs = 0.0;
+
+        // Trace the timed blocks only, not the warmup
+        auto& tracer = processor.getHopTracer();
+
+        if (options.traceFile != juce::File() && !tracer.startTracing(getTraceFile(options.traceFile, c)))
+            std::cerr << "Can't write " << getTraceFile(options.traceFile, c).getFullPathName() << std::endl;
+
+        const bool tracing = tracer.isTracing();
+
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            fillWithNoise();
+
+            const auto start = juce::Time::getHighResolutionTicks();
+            processor.processBlock(buffer, midi);
+            const auto elapsedNs = (double) (juce::Time::getHighResolutionTicks() - start) * ticksToNs;
+
+            blockTimesNs.push_back(elapsedNs);
+            totalNs += elapsedNs;
+        }
+
+        const auto numDroppedTraceEvents = tracer.getNumDroppedEvents();
+        tracer.stopTracing();
+        processor.releaseResources();
+
+        const double numSamples = (double) numBlocks * c.blockSize;
+        const double numHops = numSamples / ((1 << c.fftOrder) / benchmarkOverlap) * c.numChannels;
+        std::sort(blockTimesNs.begin(), blockTimesNs.end());
+
+        auto* result = new juce::DynamicObject();
+        result->setProperty("scenario", c.scenario->name);
+        result->setProperty("fftSize", 1 << c.fftOrder);
+        result->setProperty("overlap", benchmarkOverlap);
+        result->setProperty("channels", c.numChannels);
+        result->setProperty("blockSize", c.blockSize);
+        result->setProperty("blocks", numBlocks);
+        result->setProperty("nsPerSample", totalNs / numSamples);
+        result->setProperty("hopsPerSecond", numHops / (totalNs * 1.0e-9));
+        result->setProperty("realtimeFactor", (numSamples / benchmarkSampleRate) / (totalNs * 1.0e-9));
+        result->setProperty("blockNsP50", getPercentile(blockTimesNs, 0.50));
+        result->setProperty("blockNsP99", getPercentile(blockTimesNs, 0.99));
+        result->setProperty("blockNsMax", blockTimesNs.back());
+
+        if (tracing)
+            result->setProperty("droppedTraceEvents", (juce::int64) numDroppedTraceEvents);
+
+        return result;
+    }
+
+    //==============================================================================
+    bool parseArguments(const juce::StringArray& args, Options& options)
+    {
+        for (int i = 0; i < args.size(); ++i)
+        {
+            const auto& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+
+            if (arg == "--quick")
+                options.quick = true;
+            else if (arg == "--seconds" && hasValue)
+                options.secondsPerCase = juce::jmax(0.01, args[++i].getDoubleValue());
+            else if (arg == "--unpaired")
+                options.pairedTransforms = false;
+            else if (arg == "--isa" && hasValue)
+                options.instructionSet = args[++i].toLowerCase();
+            else if (arg == "--output" && hasValue)
+                options.outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+            else if (arg == "--trace" && hasValue)
+                options.traceFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+            else
+                return false;
+        }
+
+        return true;
+    }
+
+    bool selectInstructionSet(const juce::String& name)
+    {
+        using InstructionSet = SpectralKernels::InstructionSet;
+
+        for (auto set : { InstructionSet::scalar, InstructionSet::sse2, InstructionSet::avx2, InstructionSet::avx512 })
+        {
+            if (name == juce::String(SpectralKernels::getInstructionSetName(set)).toLowerCase().removeCharacters("-"))
+            {
+                SpectralKernels::setInstructionSet(set);
+                return SpectralKernels::getInstructionSet() == set;
+            }
+        }
+
+        return false;
+    }
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    // The processor's parameter tree and async updaters expect a message manager
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    Options options;
+
+    if (!parseArguments(juce::StringArray(argv + 1, argc - 1), options))
+    {
+        std::cerr << "Usage: NewVerbTk1Benchmark [--quick] [--seconds <s>] [--isa scalar|sse2|avx2|avx512] [--unpaired] [--output <file.json>] [--trace <file.json>]" << std::endl;
+        return 1;
+    }
+
+    if (options.instructionSet.isNotEmpty() && !selectInstructionSet(options.instructionSet))
+    {
+        std::cerr << "Instruction set " << options.instructionSet << " is unknown or not supported by this CPU" << std::endl;
+        return 1;
+    }
+
+    const auto cases = buildCases(options);
+    juce::Array<juce::var> results;
+
+    for (int i = 0; i < cases.size(); ++i)
+    {
+        const auto& c = cases.getReference(i);
+        std::cerr << "[" << (i + 1) << "/" << cases.size() << "] " << c.scenario->name << " fft " << (1 << c.fftOrder)
+                  << " ch " << c.numChannels << " block " << c.blockSize << std::endl;
+
+        results.add(runCase(c, options));
+    }
+
+    // Everything needed to compare two runs goes in the report
+    auto* report = new juce::DynamicObject();
+    report->setProperty("plugin", JucePlugin_Name);
+    report->setProperty("timestamp", juce::Time::getCurrentTime().toISO8601(true));
+    report->setProperty("cpu", juce::SystemStats::getCpuModel());
+    report->setProperty("instructionSet", SpectralKernels::getInstructionSetName(SpectralKernels::getInstructionSet()));
+    report->setProperty("pairedTransforms", options.pairedTransforms);
+    report->setProperty("sampleRate", benchmarkSampleRate);
+    report->setProperty("secondsPerCase", options.secondsPerCase);
+    report->setProperty("results", results);
+
+    const auto json = juce::JSON::toString(juce::var(report));
+
+    if (options.outputFile == juce::File())
+    {
+        std::cout << json << std::endl;
+    }
+    else if (!options.outputFile.replaceWithText(json))
+    {
+        std::cerr << "Can't write " << options.outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
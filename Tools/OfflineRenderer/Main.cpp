@@ -0,0 +1,352 @@
+﻿#include <JuceHeader.h>
+#include "../../PluginProcessor.h"
+
+//==============================================================================
+/**
+ * NewVerbTk1 offline renderer
+ * Streams audio files through NewVerbTk1AudioProcessor without a host.
+ *
+ *   NewVerbTk1Render --output <dir> [--state <file>] [--param <id>=<value>]...
+ *                    [--block <samples>] [--jobs <n>] [--tail <seconds>] [--trace <file.json>] <input>...
+ *
+ * --state takes either a blob written by getStateInformation() or the state
+ * XML that earlier versions saved. --param values are in the parameter's own
+ * units and are applied after the state. Every input is rendered by its own
+ * processor instance on a pool of worker threads, compensated for the plugin
+ * latency, extended by the reverb tail and written to the output directory
+ * under the same name. Inputs in a format JUCE can write (WAV, AIFF, FLAC,
+ * Ogg Vorbis) keep it; anything else is written as WAV with a .wav extension.
+ * --trace writes a Chrome trace of the processing, one per input when there
+ * are several, named after the input. The exit code is the number of files
+ * that failed.
+ */
+namespace
+{
+    struct RenderOptions
+    {
+        juce::File outputDirectory;
+        juce::MemoryBlock state;
+        juce::StringPairArray parameterValues;
+        int blockSize = 8192;
+        int numJobs = juce::SystemStats::getNumCpus();
+        double tailSeconds = 2.0;
+        juce::File traceFile;
+        juce::Array<juce::File> inputs;
+    };
+
+    void printUsage()
+    {
+        std::cout << "Usage: NewVerbTk1Render --output <dir> [--state <file>] [--param <id>=<value>]..." << std::endl
+                  << "                        [--block <samples>] [--jobs <n>] [--tail <seconds>] [--trace <file.json>] <input>..." << std::endl;
+    }
+
+    // Accepts a getStateInformation() blob, or the bare XML of an earlier version's state
+    bool loadState(const juce::File& file, juce::MemoryBlock& state)
+    {
+        if (!file.loadFileAsData(state))
+            return false;
+
+        if (auto xml = juce::parseXML(state.toString()))
+        {
+            state.reset();
+            juce::AudioProcessor::copyXmlToBinary(*xml, state);
+        }
+
+        return state.getSize() > 0;
+    }
+
+    bool parseArguments(const juce::StringArray& args, RenderOptions& options)
+    {
+        for (int i = 0; i < args.size(); ++i)
+        {
+            const auto& arg = args[i];
+            const bool hasValue = i + 1 < args.size();
+
+            if (arg == "--output" && hasValue)
+            {
+                options.outputDirectory = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+            }
+            else if (arg == "--state" && hasValue)
+            {
+                const auto stateFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+
+                if (!loadState(stateFile, options.state))
+                {
+                    std::cerr << "Can't read state from " << stateFile.getFullPathName() << std::endl;
+                    return false;
+                }
+            }
+            else if (arg == "--param" && hasValue && args[i + 1].containsChar('='))
+            {
+                const auto assignment = args[++i];
+                options.parameterValues.set(assignment.upToFirstOccurrenceOf("=", false, false).trim(),
+                                            assignment.fromFirstOccurrenceOf("=", false, false).trim());
+            }
+            else if (arg == "--block" && hasValue)
+            {
+                options.blockSize = juce::jlimit(16, 1 << 16, args[++i].getIntValue());
+            }
+            else if (arg == "--jobs" && hasValue)
+            {
+                options.numJobs = juce::jmax(1, args[++i].getIntValue());
+            }
+            else if (arg == "--tail" && hasValue)
+            {
+                options.tailSeconds = juce::jmax(0.0, args[++i].getDoubleValue());
+            }
+            else if (arg == "--trace" && hasValue)
+            {
+                options.traceFile = juce::File::getCurrentWorkingDirectory().getChildFile(args[++i]);
+            }
+            else if (arg.startsWith("--"))
+            {
+                std::cerr << "Unknown option " << arg << std::endl;
+                return false;
+            }
+            else
+            {
+                options.inputs.add(juce::File::getCurrentWorkingDirectory().getChildFile(arg));
+            }
+        }
+
+        return options.outputDirectory != juce::File() && !options.inputs.isEmpty();
+    }
+
+    //==============================================================================
+    // Renders one file with a processor of its own
+    class RenderJob : public juce::ThreadPoolJob
+    {
+    public:
+        RenderJob(const RenderOptions& o, const juce::File& file)
+            : juce::ThreadPoolJob("Render " + file.getFileName()), options(o), inputFile(file)
+        {
+        }
+
+        JobStatus runJob() override
+        {
+            const auto startTime = juce::Time::getMillisecondCounterHiRes();
+            errorMessage = render();
+            succeeded = errorMessage.isEmpty();
+
+            const juce::ScopedLock sl(getConsoleLock());
+
+            if (succeeded)
+                std::cout << inputFile.getFileName() << ": rendered in "
+                          << juce::String((juce::Time::getMillisecondCounterHiRes() - startTime) / 1000.0, 2) << " s" << std::endl;
+            else
+                std::cerr << inputFile.getFileName() << ": " << errorMessage << std::endl;
+
+            return jobHasFinished;
+        }
+
+        bool hasSucceeded() const noexcept { return succeeded; }
+
+    private:
+        static juce::CriticalSection& getConsoleLock()
+        {
+            static juce::CriticalSection lock;
+            return lock;
+        }
+
+        juce::String render()
+        {
+            juce::AudioFormatManager formatManager;
+            formatManager.registerBasicFormats();
+
+            std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(inputFile));
+
+            if (reader == nullptr)
+                return "can't read the file";
+
+            const int numChannels = (int) reader->numChannels;
+            const double sampleRate = reader->sampleRate;
+
+            // Set the processor up exactly as a host would, but for offline use
+            NewVerbTk1AudioProcessor processor;
+
+            juce::AudioProcessor::BusesLayout layout;
+            layout.inputBuses.add(juce::AudioChannelSet::canonicalChannelSet(numChannels));
+            layout.outputBuses.add(juce::AudioChannelSet::canonicalChannelSet(numChannels));
+
+            if (!processor.setBusesLayout(layout))
+                return "unsupported channel count (" + juce::String(numChannels) + ")";
+
+            // State first, so prepareToPlay builds the engine and convolver it asks for
+            if (options.state.getSize() > 0)
+                processor.setStateInformation(options.state.getData(), (int) options.state.getSize());
+
+            for (const auto& parameterID : options.parameterValues.getAllKeys())
+            {
+                auto* parameter = processor.parameters.getParameter(parameterID);
+
+                if (parameter == nullptr)
+                    return "unknown parameter " + parameterID;
+
+                const float value = options.parameterValues[parameterID].getFloatValue();
+                parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+            }
+
+            processor.setNonRealtime(true);
+            processor.setRateAndBufferSizeDetails(sampleRate, options.blockSize);
+            processor.prepareToPlay(sampleRate, options.blockSize);
+
+            // The source's own format if it can be written, otherwise WAV. Either way the
+            // extension names the format actually written.
+            juce::Array<juce::AudioFormat*> outputFormats;
+
+            for (int i = 0; i < formatManager.getNumKnownFormats(); ++i)
+                if (formatManager.getKnownFormat(i)->getFormatName() == reader->getFormatName())
+                    outputFormats.add(formatManager.getKnownFormat(i));
+
+            outputFormats.addIfNotAlreadyThere(formatManager.findFormatForFileExtension("wav"));
+
+            juce::File outputFile;
+            std::unique_ptr<juce::AudioFormatWriter> writer;
+
+            for (auto* format : outputFormats)
+            {
+                outputFile = options.outputDirectory.getChildFile(inputFile.getFileNameWithoutExtension())
+                                                    .withFileExtension(format->getFileExtensions()[0]);
+                writer = createWriterFor(*format, outputFile, *reader);
+
+                if (writer != nullptr)
+                    break;
+            }
+
+            if (writer == nullptr)
+                return "can't write " + outputFile.getFullPathName();
+
+            // Run the input, then silence for the latency and the tail, and drop
+            // the first latency samples so the output lines up with the input
+            const juce::int64 inputLength = reader->lengthInSamples;
+            const juce::int64 latency = processor.getLatencySamples();
+            const double tailSeconds = juce::jmax(options.tailSeconds, processor.getTailLengthSeconds());
+            const juce::int64 outputLength = inputLength + (juce::int64) std::ceil(tailSeconds * sampleRate);
+
+            juce::AudioBuffer<float> buffer(numChannels, options.blockSize);
+            juce::MidiBuffer midi;
+            juce::int64 samplesToSkip = latency;
+
+            // This job is the processor's only thread, so it starts and stops the trace too
+            auto& tracer = processor.getHopTracer();
+
+            if (options.traceFile != juce::File() && !tracer.startTracing(getTraceFile()))
+                return "can't write " + getTraceFile().getFullPathName();
+
+            for (juce::int64 position = 0; position < outputLength + latency; position += options.blockSize)
+            {
+                const int blockLength = (int) juce::jmin((juce::int64) options.blockSize, outputLength + latency - position);
+                const int samplesFromFile = (int) juce::jlimit((juce::int64) 0, (juce::int64) blockLength, inputLength - position);
+
+                buffer.setSize(numChannels, blockLength, false, false, true);
+                buffer.clear();
+
+                if (samplesFromFile > 0)
+                    reader->read(&buffer, 0, samplesFromFile, position, true, true);
+
+                processor.processBlock(buffer, midi);
+
+                const int skip = (int) juce::jmin(samplesToSkip, (juce::int64) blockLength);
+                samplesToSkip -= skip;
+
+                if (skip < blockLength && !writer->writeFromAudioSampleBuffer(buffer, skip, blockLength - skip))
+                    return "write failed";
+            }
+
+            tracer.stopTracing();
+            processor.releaseResources();
+            return {};
+        }
+
+        // The file given, or with several inputs, e.g. trace.json -> trace_input.json
+        juce::File getTraceFile() const
+        {
+            if (options.inputs.size() == 1)
+                return options.traceFile;
+
+            return options.traceFile.getSiblingFile(options.traceFile.getFileNameWithoutExtension() + "_"
+                                                    + inputFile.getFileNameWithoutExtension() + options.traceFile.getFileExtension());
+        }
+
+        // Writes format with the source's channel count and rate, and its bit depth or
+        // the deepest one format supports. Returns nullptr, leaving no file, on failure.
+        static std::unique_ptr<juce::AudioFormatWriter> createWriterFor(juce::AudioFormat& format, const juce::File& file,
+                                                                        const juce::AudioFormatReader& reader)
+        {
+            const auto bitDepths = format.getPossibleBitDepths();
+            int bitsPerSample = (int) reader.bitsPerSample;
+
+            if (!bitDepths.isEmpty() && !bitDepths.contains(bitsPerSample))
+                bitsPerSample = juce::findMaximum(bitDepths.begin(), bitDepths.size());
+
+            file.deleteFile();
+            std::unique_ptr<juce::FileOutputStream> stream(file.createOutputStream());
+
+            if (stream == nullptr)
+                return {};
+
+            std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(stream.get(), reader.sampleRate, reader.numChannels,
+                                                                                   bitsPerSample, {}, 0));
+
+            // On success the writer owns the stream
+            if (writer != nullptr)
+            {
+                stream.release();
+            }
+            else
+            {
+                stream.reset();
+                file.deleteFile();
+            }
+
+            return writer;
+        }
+
+        const RenderOptions& options;
+        const juce::File inputFile;
+        juce::String errorMessage;
+        bool succeeded = false;
+
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RenderJob)
+    };
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    // The processor's parameter tree and async updaters expect a message manager
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    RenderOptions options;
+
+    if (!parseArguments(juce::StringArray(argv + 1, argc - 1), options))
+    {
+        printUsage();
+        return 1;
+    }
+
+    if (!options.outputDirectory.createDirectory())
+    {
+        std::cerr << "Can't create " << options.outputDirectory.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    // The jobs outlive the pool, which only borrows them
+    juce::OwnedArray<RenderJob> jobs;
+    juce::ThreadPool pool(juce::jmin(options.numJobs, options.inputs.size()));
+
+    for (const auto& input : options.inputs)
+        pool.addJob(jobs.add(new RenderJob(options, input)), false);
+
+    while (pool.getNumJobs() > 0)
+        juce::Thread::sleep(50);
+
+    int numFailed = 0;
+
+    for (auto* job : jobs)
+        if (!job->hasSucceeded())
+            ++numFailed;
+
+    std::cout << options.inputs.size() - numFailed << " of " << options.inputs.size() << " files rendered" << std::endl;
+    return numFailed;
+}